@@ -36,5 +36,22 @@ LOCAL_SRC_FILES += \
 	topology.c \
 	trace.c    \
 	utils.c   \
+	tracefile.c \
+	parser.c \
+	import.c \
+	pool.c \
+	pipeline.c \
+	scan.c \
+	merge.c \
+	tracedat.c \
+	compress.c \
+	cache.c \
+	index.c \
+	shard.c \
+	arena.c \
+	interval.c \
+	summary.c \
+	cluster.c \
+	spill.c \
 
 include $(BUILD_EXECUTABLE)
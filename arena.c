@@ -0,0 +1,124 @@
+/*
+ *  arena.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "spill.h"
+
+#define ARENA_ALIGN 16
+
+/**
+ * arena_alloc - allocate zeroed memory from an arena
+ * @arena: the arena
+ * @size: the size of the object
+ *
+ * Return: the object, aligned on 16 bytes, or NULL if out of memory
+ */
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	struct arena_block *block = arena->blocks;
+	void *p;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (!block || block->size - block->used < size) {
+		size_t bsize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+		block = spill_block_alloc(sizeof(*block) + bsize);
+		if (!block)
+			return NULL;
+
+		block->size = bsize;
+		block->used = 0;
+
+		/* an oversized object does not retire the current block */
+		if (size > ARENA_BLOCK_SIZE && arena->blocks) {
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		} else {
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+		arena->nrblocks++;
+	}
+
+	p = block->data + block->used;
+	block->used += size;
+	memset(p, 0, size);
+
+	return p;
+}
+
+/**
+ * arena_release - free all the objects of an arena
+ * @arena: the arena, it can be used again afterwards
+ */
+void arena_release(struct arena *arena)
+{
+	struct arena_block *block, *next;
+
+	for (block = arena->blocks; block; block = next) {
+		next = block->next;
+		spill_block_free(block, sizeof(*block) + block->size);
+	}
+
+	arena->blocks = NULL;
+}
+
+/**
+ * arena_splice - move the objects of an arena into another one
+ * @dst: the arena taking the objects, its current block stays current
+ * @src: the arena to empty, it can be used again afterwards
+ */
+void arena_splice(struct arena *dst, struct arena *src)
+{
+	struct arena_block *last;
+
+	if (!src->blocks)
+		return;
+
+	for (last = src->blocks; last->next; last = last->next)
+		;
+
+	if (dst->blocks) {
+		last->next = dst->blocks->next;
+		dst->blocks->next = src->blocks;
+	} else {
+		dst->blocks = src->blocks;
+	}
+
+	dst->nrblocks += src->nrblocks;
+	dst->nritems += src->nritems;
+	memset(src, 0, sizeof(*src));
+}
+
+/**
+ * arena_usage - add the counters of an arena to a total
+ * @total: the arena holding the total, its blocks are not touched
+ * @arena: the arena to account
+ */
+void arena_usage(struct arena *total, const struct arena *arena)
+{
+	total->nrblocks += arena->nrblocks;
+	total->nritems += arena->nritems;
+}
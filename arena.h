@@ -0,0 +1,52 @@
+/*
+ *  arena.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stddef.h>
+
+/*
+ * A bump allocator: the objects are carved out of large blocks, they
+ * never move and are only freed all at once, with the arena. Each arena
+ * is used by a single thread at a time.
+ */
+#define ARENA_BLOCK_SIZE (256 * 1024)
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	char data[] __attribute__((aligned(16)));
+};
+
+struct arena {
+	struct arena_block *blocks;	/* the current block first */
+	unsigned long nrblocks;		/* calls to the allocator */
+	unsigned long nritems;		/* objects stored in the blocks */
+};
+
+extern void *arena_alloc(struct arena *arena, size_t size);
+extern void arena_release(struct arena *arena);
+extern void arena_splice(struct arena *dst, struct arena *src);
+extern void arena_usage(struct arena *total, const struct arena *arena);
+
+#endif
@@ -0,0 +1,457 @@
+/*
+ *  bench.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+
+/*
+ * Micro-benchmarks of the import, run by 'make bench':
+ *
+ *   bench/idlestat-bench [-s <MB>] [-c <cpus>] [-r <runs>] [<bench>...]
+ *
+ * The benchmarks are "scan" (the line splitting kernels, against memchr()),
+ * "parse" (the trace line decoder, against the sscanf() it replaced) and
+ * "intersect" (the C-states of a group of CPUs).
+ * They run on a synthetic trace and synthetic idle intervals built in
+ * memory from a fixed seed, so two builds can be compared on the same
+ * input. Each timing is the best of the runs.
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "interval.h"
+#include "parser.h"
+#include "scan.h"
+
+struct bench_options {
+	size_t size;		/* of the trace, in bytes */
+	int nrcpus;
+	int runs;
+};
+
+#define BENCH_SEED 0x9e3779b97f4a7c15ULL
+
+static uint64_t bench_seed = BENCH_SEED;
+
+/* xorshift64, the inputs only need to be the same from run to run */
+static uint64_t bench_random_r(uint64_t *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+
+	return *seed;
+}
+
+static uint64_t bench_random(void)
+{
+	return bench_random_r(&bench_seed);
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * A text trace with the events of the import: each CPU goes idle in a
+ * random C-state and wakes up on an IRQ or an IPI, and changes its
+ * frequency from time to time.
+ */
+static char *bench_trace(const struct bench_options *options, size_t *size)
+{
+	uint64_t time = 1000000000000ULL, *next;
+	char *trace, *p, *end;
+	int cpu, *state;
+
+	trace = malloc(options->size + 256);
+	next = calloc(options->nrcpus, sizeof(*next));
+	state = malloc(options->nrcpus * sizeof(*state));
+	if (!trace || !next || !state) {
+		free(trace);
+		trace = NULL;
+		goto out;
+	}
+
+	for (cpu = 0; cpu < options->nrcpus; cpu++)
+		state[cpu] = -1;
+
+	p = trace;
+	end = trace + options->size;
+	while (p < end) {
+		cpu = bench_random() % options->nrcpus;
+		time += bench_random() % 20000;
+
+#define LINE(fmt, ...)							\
+	p += sprintf(p, "          <idle>-0     [%03d] d..2 %5lu.%06lu: " fmt \
+		     "\n", cpu, (unsigned long)(time / 1000000000),	\
+		     (unsigned long)(time % 1000000000 / 1000), __VA_ARGS__)
+
+		if (state[cpu] < 0) {
+			state[cpu] = bench_random() % 4;
+			LINE("cpu_idle: state=%d cpu_id=%d", state[cpu], cpu);
+		} else {
+			LINE("cpu_idle: state=4294967295 cpu_id=%d", cpu);
+			if (bench_random() % 4)
+				LINE("irq_handler_entry: irq=%d name=timer",
+				     27);
+			else
+				LINE("ipi_entry: (%s)",
+				     "Rescheduling interrupts");
+			state[cpu] = -1;
+		}
+
+		if (!(++next[cpu] % 16))
+			LINE("cpu_frequency: state=%lu cpu_id=%d",
+			     800000 + 200000 * (bench_random() % 8), cpu);
+#undef LINE
+	}
+
+	*size = p - trace;
+out:
+	free(next);
+	free(state);
+
+	return trace;
+}
+
+/* each kernel the CPU can run, and memchr() as the reference */
+static void bench_scan(const struct bench_options *options, const char *trace,
+		       size_t size)
+{
+	const char *eols[SCAN_LINES_BATCH], *p, *end = trace + size;
+	const struct scan_ops **k;
+	double t, best[2];
+	size_t lines[2] = { 0 }, ref = 0, n;
+	int i;
+
+	for (i = 0, best[0] = 1e9; i < options->runs; i++) {
+		t = bench_now();
+		for (p = trace, ref = 0; (p = memchr(p, '\n', end - p)); p++)
+			ref++;
+		best[0] = MIN(best[0], bench_now() - t);
+	}
+
+	printf("scan      memchr            %8.0f MB/s\n",
+	       size / best[0] / 1e6);
+
+	for (k = scan_kernels; *k; k++) {
+		best[0] = best[1] = 1e9;
+		for (i = 0; i < options->runs; i++) {
+			t = bench_now();
+			for (p = trace, lines[0] = 0;
+			     (p = (*k)->find_char(p, end, '\n')); p++)
+				lines[0]++;
+			best[0] = MIN(best[0], bench_now() - t);
+
+			t = bench_now();
+			for (p = trace, lines[1] = 0;
+			     (n = (*k)->find_lines(p, end, eols,
+						   SCAN_LINES_BATCH));
+			     p = eols[n - 1] + 1)
+				lines[1] += n;
+			best[1] = MIN(best[1], bench_now() - t);
+		}
+
+		if (lines[0] != ref || lines[1] != ref)
+			fprintf(stderr, "%s: %s found %zu and %zu lines "
+				"instead of %zu\n", __func__, (*k)->name,
+				lines[0], lines[1], ref);
+
+		printf("scan      %-6s find_char  %8.0f MB/s\n", (*k)->name,
+		       size / best[0] / 1e6);
+		printf("scan      %-6s find_lines %8.0f MB/s\n", (*k)->name,
+		       size / best[1] / 1e6);
+	}
+}
+
+/*
+ * The decoder parse_trace_line() replaced: each line copied as fgets()
+ * did, filtered with strstr() and decoded by sscanf(). It only decodes
+ * the cpu_idle and cpu_frequency events, so it counts fewer events than
+ * the parser: the ratio printed is the one of the times on the same trace.
+ */
+#define BENCH_TRACE_FORMAT "%*[^]]] %*s %lf:%*[^=]=%u%*[^=]=%d"
+
+static size_t bench_parse_sscanf(const char *trace, size_t size)
+{
+	const char *p, *eol, *end = trace + size;
+	char line[1024];
+	size_t len, events = 0;
+	unsigned int state;
+	double time;
+	int cpu;
+
+	for (p = trace; p < end; p = eol + 1) {
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		len = MIN((size_t)(eol - p), sizeof(line) - 1);
+		memcpy(line, p, len);
+		line[len] = '\0';
+
+		if ((strstr(line, "cpu_idle") || strstr(line, "cpu_frequency")) &&
+		    sscanf(line, BENCH_TRACE_FORMAT, &time, &state, &cpu) == 3)
+			events++;
+	}
+
+	return events;
+}
+
+static void bench_parse(const struct bench_options *options,
+			const char *trace, size_t size)
+{
+	const char *eols[SCAN_LINES_BATCH], *p, *end = trace + size;
+	struct trace_event ev;
+	double t, best[2] = { 1e9, 1e9 };
+	size_t i, n, events[2] = { 0 };
+	int run;
+
+	for (run = 0; run < options->runs; run++) {
+		t = bench_now();
+		events[0] = bench_parse_sscanf(trace, size);
+		best[0] = MIN(best[0], bench_now() - t);
+
+		t = bench_now();
+		events[1] = 0;
+		for (p = trace; (n = scan_lines(p, end, eols, SCAN_LINES_BATCH));
+		     p = eols[n - 1] + 1)
+			for (i = 0; i < n; p = eols[i++] + 1)
+				events[1] += !parse_trace_line(p, eols[i] - p,
+							       &ev);
+		best[1] = MIN(best[1], bench_now() - t);
+	}
+
+	printf("parse     sscanf %9zu events %8.0f MB/s %8.1f Mevents/s\n",
+	       events[0], size / best[0] / 1e6, events[0] / best[0] / 1e6);
+	printf("parse     parser %9zu events %8.0f MB/s %8.1f Mevents/s "
+	       "x%.1f\n", events[1], size / best[1] / 1e6,
+	       events[1] / best[1] / 1e6, best[0] / best[1]);
+}
+
+/*
+ * The idle intervals of the CPUs of a group, over @duration ns, in
+ * periods of 0.5 to 1ms. When they are correlated, the CPUs share the
+ * periods and are idle for most of each, otherwise each CPU has its own
+ * periods and is idle for a random part of them.
+ */
+static struct cpuidle_cstate *bench_cstates(int nrcpus, uint64_t duration,
+					    bool correlated, bool compact,
+					    struct arena *arena)
+{
+	struct cpuidle_cstate *cs;
+	struct cpuidle_data data;
+	uint64_t time, period, seed;
+	int cpu;
+
+	cs = calloc(nrcpus, sizeof(*cs));
+	if (!cs)
+		return NULL;
+
+	for (cpu = 0; cpu < nrcpus; cpu++) {
+		cs[cpu].compact = compact;
+		seed = correlated ? BENCH_SEED : bench_random();
+		for (time = 0; time < duration; time += period) {
+			period = 500000 + bench_random_r(&seed) % 500000;
+			if (correlated) {
+				data.begin = time + bench_random() % 50000;
+				data.end = time + period -
+					   bench_random() % 50000;
+			} else {
+				data.begin = time + bench_random() % period;
+				data.end = data.begin + (time + period -
+					   data.begin) * (bench_random() % 4) / 4;
+				if (data.end <= data.begin)
+					continue;
+			}
+
+			if (cstate_add(&cs[cpu], &data, arena)) {
+				free(cs);
+				return NULL;
+			}
+		}
+	}
+
+	return cs;
+}
+
+static void bench_intersect(const struct bench_options *options,
+			    const char *trace, size_t size)
+{
+	static const struct {
+		const char *name;
+		bool correlated;
+		bool compact;
+	} cases[] = {
+		{ "correlated", true, false },
+		{ "independent", false, false },
+		{ "correlated compact", true, true },
+		{ "independent compact", false, true },
+	};
+	struct cpuidle_cstate *cs, **pcs, result;
+	struct arena arena = { 0 }, rarena;
+	double t, best;
+	unsigned int i;
+	int cpu, run;
+
+	pcs = malloc(options->nrcpus * sizeof(*pcs));
+	if (!pcs)
+		return;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		/* 20s of trace */
+		cs = bench_cstates(options->nrcpus, 20 * NSEC_PER_SEC,
+				   cases[i].correlated, cases[i].compact,
+				   &arena);
+		if (!cs)
+			break;
+
+		for (cpu = 0; cpu < options->nrcpus; cpu++)
+			pcs[cpu] = &cs[cpu];
+
+		for (run = 0, best = 1e9; run < options->runs; run++) {
+			memset(&result, 0, sizeof(result));
+			memset(&rarena, 0, sizeof(rarena));
+			result.compact = cases[i].compact;
+
+			t = bench_now();
+			if (cstate_intersect(&result, pcs, options->nrcpus,
+					     &rarena))
+				fprintf(stderr, "%s: out of memory\n",
+					__func__);
+			best = MIN(best, bench_now() - t);
+			arena_release(&rarena);
+		}
+
+		printf("intersect %d CPUs %-20s %8.2f ms, %d intervals\n",
+		       options->nrcpus, cases[i].name, best * 1e3,
+		       result.nrdata);
+
+		free(cs);
+		arena_release(&arena);
+	}
+
+	free(pcs);
+}
+
+static const struct bench {
+	const char *name;
+	void (*run)(const struct bench_options *options, const char *trace,
+		    size_t size);
+	bool trace;		/* runs on the synthetic trace */
+} benches[] = {
+	{ "scan", bench_scan, true },
+	{ "parse", bench_parse, true },
+	{ "intersect", bench_intersect, false },
+	{ NULL },
+};
+
+static const struct bench *bench_lookup(const char *name)
+{
+	const struct bench *b;
+
+	for (b = benches; b->name; b++)
+		if (!strcmp(b->name, name))
+			return b;
+
+	return NULL;
+}
+
+/* the benchmark was asked for, all of them are run without argument */
+static bool bench_selected(const struct bench *b, int argc, char *argv[])
+{
+	int i;
+
+	for (i = optind; i < argc; i++)
+		if (!strcmp(argv[i], b->name))
+			return true;
+
+	return optind == argc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_options options = {
+		.size = 64 << 20,
+		.nrcpus = 64,
+		.runs = 5,
+	};
+	const struct bench *b;
+	char *trace = NULL;
+	size_t size = 0;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "s:c:r:")) != -1) {
+		switch (opt) {
+		case 's':
+			options.size = strtoul(optarg, NULL, 10) << 20;
+			break;
+		case 'c':
+			options.nrcpus = atoi(optarg);
+			break;
+		case 'r':
+			options.runs = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s <MB>] [-c <cpus>] "
+				"[-r <runs>] [<bench>...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!options.size || options.nrcpus <= 0 || options.runs <= 0) {
+		fprintf(stderr, "%s: invalid options\n", argv[0]);
+		return 1;
+	}
+
+	for (i = optind; i < argc; i++)
+		if (!bench_lookup(argv[i])) {
+			fprintf(stderr, "%s: unknown benchmark '%s'\n",
+				argv[0], argv[i]);
+			return 1;
+		}
+
+	for (b = benches; b->name; b++) {
+		if (!bench_selected(b, argc, argv))
+			continue;
+
+		if (b->trace && !trace) {
+			trace = bench_trace(&options, &size);
+			if (!trace) {
+				fprintf(stderr, "%s: out of memory\n", argv[0]);
+				return 1;
+			}
+		}
+
+		b->run(&options, trace, size);
+	}
+
+	free(trace);
+
+	return 0;
+}
@@ -0,0 +1,751 @@
+/*
+ *  cache.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "interval.h"
+#include "topology.h"
+#include "tracefile.h"
+#include "utils.h"
+
+/*
+ * The statistics built from a trace are saved in a sidecar file, so the
+ * trace is not parsed again when the report is displayed another way.
+ * The file holds the per-CPU structures as they are in memory, followed
+ * by the arrays they point to: it is only meant to be read back on the
+ * same host by the same build, which the version and the layout size
+ * check. The idle intervals are used in place from the mapping.
+ *
+ * The cache is tied to its trace by the size, the modification time and
+ * a hash of the beginning and the end of the trace.
+ *
+ * The cache is also a checkpoint of the import of a text trace: it keeps
+ * the idle periods still open and the number of bytes of the trace it
+ * covers, with a hash of these bytes. When the trace was appended to
+ * since, the import resumes from the cached state and only parses the
+ * new lines.
+ */
+#define CACHE_MAGIC "idlestat-cache"
+#define CACHE_VERSION 7
+#define CACHE_HASH_SIZE (64 << 10)
+#define CACHE_ALIGN 8
+
+struct cache_header {
+	char magic[16];
+	uint32_t version;
+	uint32_t cpu_size;	/* layout check */
+	struct cache_key key;
+	uint64_t offset;	/* bytes of trace covered, 0 if not resumable */
+	uint64_t offset_hash;
+	uint64_t begin;		/* import statistics */
+	uint64_t end;
+	uint64_t count;
+	uint64_t topology;	/* offset of the topology text */
+	uint64_t topology_len;
+	uint64_t cpus;		/* offset of the cache_cpu array */
+	int32_t nrcpus;
+};
+
+/* the pointers of the copied structures are replaced by the offsets */
+struct cache_cpu {
+	struct cpuidle_cstates cstates;
+	struct cpufreq_pstates pstates;
+	uint64_t names[MAXCSTATE];
+	uint64_t data[MAXCSTATE];
+	uint64_t irqinfo;
+	uint64_t pstate;
+	int32_t wakeirq;	/* index in irqinfo, -1 if none */
+};
+
+/* FNV-1a */
+static uint64_t cache_hash(uint64_t hash, const unsigned char *p, size_t len)
+{
+	while (len--)
+		hash = (hash ^ *p++) * 0x100000001b3ULL;
+
+	return hash;
+}
+
+/* hash the first and the last CACHE_HASH_SIZE bytes of [0, length) */
+static int cache_hash_file(int fd, uint64_t length, uint64_t *hash)
+{
+	unsigned char *buf;
+	ssize_t len;
+	int ret = -1;
+
+	buf = malloc(CACHE_HASH_SIZE);
+	if (!buf)
+		return -1;
+
+	*hash = 0xcbf29ce484222325ULL;
+
+	len = pread(fd, buf, MIN(length, CACHE_HASH_SIZE), 0);
+	if (len < 0)
+		goto out;
+	*hash = cache_hash(*hash, buf, len);
+
+	if (length > CACHE_HASH_SIZE) {
+		len = pread(fd, buf, CACHE_HASH_SIZE, length - CACHE_HASH_SIZE);
+		if (len < 0)
+			goto out;
+		*hash = cache_hash(*hash, buf, len);
+	}
+
+	ret = 0;
+out:
+	free(buf);
+
+	return ret;
+}
+
+static void cache_key_init(struct cache_key *key, const struct stat *s)
+{
+	memset(key, 0, sizeof(*key));
+	key->size = s->st_size;
+	key->mtime_sec = s->st_mtim.tv_sec;
+	key->mtime_nsec = s->st_mtim.tv_nsec;
+}
+
+/**
+ * cache_key - identify the content of a trace without reading it all
+ * @path: the trace file
+ * @key: filled with the key of the trace
+ *
+ * Return: 0 on success, -1 if the trace is not a regular file
+ */
+int cache_key(const char *path, struct cache_key *key)
+{
+	struct stat s;
+	int fd, ret = -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	/* a pipe can not be cached */
+	if (fstat(fd, &s) || !S_ISREG(s.st_mode))
+		goto out;
+
+	cache_key_init(key, &s);
+	ret = cache_hash_file(fd, s.st_size, &key->hash);
+out:
+	close(fd);
+
+	return ret;
+}
+
+/**
+ * cache_key_stat - identify the content of a trace as it was imported
+ * @path: the trace file
+ * @s: the status of the trace when it was opened for the import
+ * @size: the number of bytes of the trace imported
+ * @key: filled with the key of the trace
+ *
+ * The trace may have been appended to during the import: the key is the
+ * one of the file as it was when the import started, the next import
+ * then sees it changed. The key covers the first @size bytes only when
+ * the import stopped before the end of the file.
+ *
+ * Return: 0 on success, -1 if the trace is not a regular file
+ */
+int cache_key_stat(const char *path, const struct stat *s, size_t size,
+		   struct cache_key *key)
+{
+	int fd, ret;
+
+	/* a pipe can not be cached */
+	if (!S_ISREG(s->st_mode))
+		return -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	cache_key_init(key, s);
+	key->size = size;
+	ret = cache_hash_file(fd, key->size, &key->hash);
+	close(fd);
+
+	return ret;
+}
+
+/* hash the @length first bytes of the trace, if it has as many */
+static int cache_hash_prefix(const char *path, uint64_t length,
+			     uint64_t *hash)
+{
+	struct stat s;
+	int fd, ret = -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (!fstat(fd, &s) && S_ISREG(s.st_mode) && s.st_size >= length)
+		ret = cache_hash_file(fd, length, hash);
+
+	close(fd);
+
+	return ret;
+}
+
+static char *cache_path(const char *path)
+{
+	char *cpath;
+
+	if (asprintf(&cpath, "%s" CACHE_SUFFIX, path) < 0)
+		return NULL;
+
+	return cpath;
+}
+
+/* return the mapped object at @offset if it fits in the file */
+static void *cache_ptr(char *map, size_t size, uint64_t offset, size_t len)
+{
+	if (offset > size || len > size - offset)
+		return NULL;
+
+	return map + offset;
+}
+
+/* use an array of the mapping in place, or a copy of it */
+static void *cache_array(char *map, size_t size, uint64_t offset,
+			 size_t len, bool copy)
+{
+	void *p, *array;
+
+	if (!len)
+		return NULL;
+
+	p = cache_ptr(map, size, offset, len);
+	if (!p || !copy)
+		return p;
+
+	array = malloc(len);
+	if (array)
+		memcpy(array, p, len);
+
+	return array;
+}
+
+/*
+ * The intervals are written as whole chunks, one after the other. The
+ * table points to the chunks in the mapping, or to copies when they can
+ * grow.
+ */
+static int cache_load_data(char *map, size_t size, uint64_t offset,
+			   struct cpuidle_cstate *c, int nrdata,
+			   struct arena *arena, bool copy)
+{
+	struct cpuidle_chunk *chunks, *chunk;
+	int i, n;
+
+	if (!nrdata)
+		return 0;
+
+	n = (nrdata + CPUIDLE_DATA_CHUNK - 1) >> CPUIDLE_DATA_CHUNK_SHIFT;
+	chunks = cache_ptr(map, size, offset, n * sizeof(*chunks));
+	if (!chunks)
+		return -1;
+
+	if (copy) {
+		for (i = 0; i < n; i++) {
+			chunk = cstate_chunk_slot(c, i << CPUIDLE_DATA_CHUNK_SHIFT,
+						  arena);
+			if (!chunk)
+				return -1;
+			*chunk = chunks[i];
+		}
+		return 0;
+	}
+
+	c->data = arena_alloc(arena, n * sizeof(*c->data));
+	if (!c->data)
+		return -1;
+
+	for (i = 0; i < n; i++)
+		c->data[i] = &chunks[i];
+	c->nrchunks = n;
+
+	return 0;
+}
+
+static int cache_load_cpu(char *map, size_t size, struct cache_cpu *cc,
+			  struct cpuidle_cstates *cstates,
+			  struct cpufreq_pstates *pstates, bool copy)
+{
+	struct cpuidle_cstate *c;
+	const char *name;
+	int i, nrdata;
+
+	*cstates = cc->cstates;
+	*pstates = cc->pstates;
+	cstates->wakeirq = NULL;
+
+	/* clear the pointers first, the structs can then be released
+	 * whatever the point of failure */
+	for (i = 0; i < MAXCSTATE; i++) {
+		cstates->cstate[i].name = NULL;
+		cstates->cstate[i].data = NULL;
+		cstates->cstate[i].nrchunks = 0;
+		cstates->cstate[i].compact = 0;
+		cstates->cstate[i].packs = NULL;
+		cstates->cstate[i].last_pack = NULL;
+	}
+	memset(&cstates->arena, 0, sizeof(cstates->arena));
+	cstates->wakeinfo.irqinfo = NULL;
+	pstates->pstate = NULL;
+
+	if (cstates->last_cstate < -1 || cstates->last_cstate >= MAXCSTATE ||
+	    cstates->wakeinfo.nrdata < 0 || cc->wakeirq < -1 ||
+	    cc->wakeirq >= cstates->wakeinfo.nrdata || pstates->max < 0)
+		return -1;
+
+	for (i = 0; i < MAXCSTATE; i++) {
+		c = &cstates->cstate[i];
+
+		if (cc->names[i]) {
+			name = cache_ptr(map, size, cc->names[i], NAMELEN + 1);
+			if (!name || !memchr(name, '\0', NAMELEN + 1))
+				return -1;
+			c->name = strdup(name);
+			if (!c->name)
+				return -1;
+		}
+
+		/* the open idle period follows the closed ones */
+		nrdata = c->nrdata + (i == cstates->last_cstate);
+		if (c->nrdata < 0 ||
+		    cache_load_data(map, size, cc->data[i], c, nrdata,
+				    &cstates->arena, copy))
+			return -1;
+	}
+
+	cstates->wakeinfo.irqinfo = cache_array(map, size, cc->irqinfo,
+		cstates->wakeinfo.nrdata * sizeof(*cstates->wakeinfo.irqinfo),
+		copy);
+	if (cstates->wakeinfo.nrdata && !cstates->wakeinfo.irqinfo)
+		return -1;
+	if (cc->wakeirq >= 0)
+		cstates->wakeirq = &cstates->wakeinfo.irqinfo[cc->wakeirq];
+
+	/* released with the pstates, it can not stay in the mapping */
+	pstates->pstate = cache_array(map, size, cc->pstate, pstates->max *
+				      sizeof(*pstates->pstate), true);
+	if (pstates->max && !pstates->pstate)
+		return -1;
+
+	return 0;
+}
+
+static void cache_release(struct cpuidle_datas *datas, bool copy)
+{
+	int cpu, i;
+
+	for (cpu = 0; cpu < datas->nrcpus; cpu++) {
+		for (i = 0; i < MAXCSTATE; i++)
+			free(datas->cstates[cpu].cstate[i].name);
+		arena_release(&datas->cstates[cpu].arena);
+		if (copy)
+			free(datas->cstates[cpu].wakeinfo.irqinfo);
+		free(datas->pstates[cpu].pstate);
+	}
+
+	free(datas->cstates);
+	free(datas->pstates);
+	free(datas);
+}
+
+/*
+ * Map the cache of a trace and rebuild the statistics. @check tells if
+ * the cache matches the trace. The arrays are copied when the import
+ * goes on, they grow and can not stay in the mapping.
+ */
+static struct cpuidle_datas *cache_open(const char *path,
+					struct import_stats *stats,
+					size_t *offset, bool copy,
+					int (*check)(const char *path,
+						     struct cache_header *))
+{
+	struct cpuidle_datas *datas = NULL;
+	struct cache_header *header;
+	struct cache_cpu *cc;
+	struct trace_file *tf;
+	char *cpath, *map, *line;
+	const char *topo;
+	struct stat s;
+	size_t len;
+	int fd, cpu;
+
+	cpath = cache_path(path);
+	if (!cpath)
+		return NULL;
+
+	fd = open(cpath, O_RDONLY);
+	free(cpath);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &s) || s.st_size < sizeof(*header)) {
+		close(fd);
+		return NULL;
+	}
+
+	/* private and writable, the displays may sort the arrays */
+	map = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		   fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	header = (struct cache_header *)map;
+	if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) ||
+	    header->version != CACHE_VERSION ||
+	    header->cpu_size != sizeof(*cc) ||
+	    header->nrcpus <= 0 || check(path, header))
+		goto out_unmap;
+
+	cc = cache_ptr(map, s.st_size, header->cpus,
+		       header->nrcpus * sizeof(*cc));
+	topo = cache_ptr(map, s.st_size, header->topology,
+			 header->topology_len);
+	if (!cc || !topo)
+		goto out_unmap;
+
+	datas = calloc(1, sizeof(*datas));
+	if (!datas)
+		goto out_unmap;
+
+	datas->cstates = aligned_calloc(header->nrcpus,
+					sizeof(*datas->cstates));
+	datas->pstates = aligned_calloc(header->nrcpus,
+					sizeof(*datas->pstates));
+	if (!datas->cstates || !datas->pstates)
+		goto out_release;
+
+	for (cpu = 0; cpu < header->nrcpus; cpu++) {
+		datas->nrcpus = cpu + 1;
+		if (cache_load_cpu(map, s.st_size, &cc[cpu],
+				   &datas->cstates[cpu], &datas->pstates[cpu],
+				   copy))
+			goto out_release;
+	}
+
+	tf = trace_file_open_mem(topo, header->topology_len);
+	if (!tf)
+		goto out_release;
+
+	line = trace_file_getline(tf, &len);
+	read_cpu_topo_info(tf, &line, &len);
+	trace_file_close(tf);
+
+	stats->begin = header->begin;
+	stats->end = header->end;
+	stats->count = header->count;
+	*offset = header->offset;
+
+	if (copy)
+		munmap(map, s.st_size);
+
+	return datas;
+
+out_release:
+	cache_release(datas, copy);
+out_unmap:
+	munmap(map, s.st_size);
+
+	return NULL;
+}
+
+static int cache_check_key(const char *path, struct cache_header *header)
+{
+	struct cache_key key;
+
+	if (cache_key(path, &key))
+		return -1;
+
+	return memcmp(&header->key, &key, sizeof(key)) ? -1 : 0;
+}
+
+static int cache_check_prefix(const char *path, struct cache_header *header)
+{
+	uint64_t hash;
+
+	if (!header->offset ||
+	    cache_hash_prefix(path, header->offset, &hash))
+		return -1;
+
+	return hash == header->offset_hash ? 0 : -1;
+}
+
+/**
+ * cache_load - load the statistics of a trace from its cache
+ * @path: the trace file
+ * @stats: filled with the import statistics
+ *
+ * The topology is read from the cache as well. The idle intervals stay
+ * in the mapping of the cache, which is never unmapped.
+ *
+ * Return: the statistics or NULL if the trace has no valid cache
+ */
+struct cpuidle_datas *cache_load(const char *path, struct import_stats *stats)
+{
+	size_t offset;
+
+	return cache_open(path, stats, &offset, false, cache_check_key);
+}
+
+/**
+ * cache_resume - load the state of an import from the cache of a trace
+ * which was appended to
+ * @path: the trace file
+ * @stats: filled with the import statistics
+ * @offset: filled with the number of bytes of the trace already imported
+ *
+ * The topology is read from the cache as well. The import can go on
+ * from @offset and be saved again with cache_store().
+ *
+ * Return: the statistics or NULL if the trace has no resumable cache
+ */
+struct cpuidle_datas *cache_resume(const char *path,
+				   struct import_stats *stats, size_t *offset)
+{
+	return cache_open(path, stats, offset, true, cache_check_prefix);
+}
+
+/* pad the file up to the alignment of the next record */
+static uint64_t cache_align(FILE *f)
+{
+	while (ftello(f) % CACHE_ALIGN)
+		fputc(0, f);
+
+	return ftello(f);
+}
+
+static uint64_t cache_write(FILE *f, const void *p, size_t len)
+{
+	uint64_t offset = cache_align(f);
+
+	fwrite(p, 1, len, f);
+
+	return offset;
+}
+
+/* the intervals are written as whole chunks, the open one last, and
+ * are always loaded in chunks */
+static uint64_t cache_write_data(FILE *f, struct cpuidle_cstate *c,
+				 bool open, struct cpuidle_chunk *buf)
+{
+	struct cpuidle_data data;
+	struct cstate_iter it;
+	uint64_t offset;
+	int i, n;
+
+	offset = cache_align(f);
+
+	if (!c->compact) {
+		for (i = 0; i < c->nrdata + open; i += CPUIDLE_DATA_CHUNK) {
+			spill_touch(cstate_chunk(c, i), sizeof(*buf));
+			fwrite(cstate_chunk(c, i), sizeof(*buf), 1, f);
+		}
+		return offset;
+	}
+
+	cstate_iter_init(&it, c);
+	do {
+		for (n = 0; n < CPUIDLE_DATA_CHUNK &&
+			    cstate_iter_next(&it, &data); n++) {
+			buf->begin[n] = data.begin;
+			buf->end[n] = data.end;
+		}
+		if (n < CPUIDLE_DATA_CHUNK && open) {
+			buf->begin[n] = c->open;
+			buf->end[n++] = 0;
+			open = false;
+		}
+		if (n)
+			fwrite(buf, sizeof(*buf), 1, f);
+	} while (n == CPUIDLE_DATA_CHUNK);
+
+	return offset;
+}
+
+/**
+ * cache_store - save the statistics of a trace in its cache
+ * @path: the trace file
+ * @key: the key of the trace as it was imported, see cache_key_stat()
+ * @datas: the statistics built from the trace
+ * @stats: the import statistics
+ * @offset: the number of bytes of the trace imported, if the import can
+ *          be resumed from there, 0 otherwise. The key must cover these
+ *          bytes only.
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int cache_store(const char *path, const struct cache_key *key,
+		struct cpuidle_datas *datas, struct import_stats *stats,
+		size_t offset)
+{
+	struct cache_header header;
+	struct cpuidle_cstates *cstates;
+	struct cpufreq_pstates *pstates;
+	struct cache_cpu *ccs, *cc;
+	struct cpuidle_chunk *buf = NULL;
+	char *cpath = NULL, *tmppath = NULL, *topo = NULL;
+	size_t topo_len = 0;
+	FILE *f = NULL, *m;
+	int cpu, i, ret = -1;
+
+	memset(&header, 0, sizeof(header));
+	header.key = *key;
+
+	/* the checkpoint is the part of the trace the key covers, hashed
+	 * as it was imported */
+	if (offset && offset == key->size) {
+		header.offset = offset;
+		header.offset_hash = key->hash;
+	}
+
+	ccs = calloc(datas->nrcpus, sizeof(*ccs));
+	if (!ccs)
+		return -1;
+
+	/* the packed intervals are written through a chunk */
+	buf = calloc(1, sizeof(*buf));
+	if (!buf)
+		goto out;
+
+	m = open_memstream(&topo, &topo_len);
+	if (!m)
+		goto out;
+	output_cpu_topo_info(m);
+	fclose(m);
+
+	cpath = cache_path(path);
+	if (!cpath || asprintf(&tmppath, "%s.tmp", cpath) < 0)
+		goto out;
+
+	f = fopen(tmppath, "w");
+	if (!f)
+		goto out;
+
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.cpu_size = sizeof(*ccs);
+	header.begin = stats->begin;
+	header.end = stats->end;
+	header.count = stats->count;
+	header.nrcpus = datas->nrcpus;
+
+	/* the header and the per-CPU records are written again once the
+	 * offsets are known */
+	cache_write(f, &header, sizeof(header));
+	header.topology = cache_write(f, topo, topo_len);
+	header.topology_len = topo_len;
+	header.cpus = cache_write(f, ccs, datas->nrcpus * sizeof(*ccs));
+
+	for (cpu = 0; cpu < datas->nrcpus; cpu++) {
+		cstates = &datas->cstates[cpu];
+		pstates = &datas->pstates[cpu];
+		cc = &ccs[cpu];
+
+		cc->cstates = *cstates;
+		cc->pstates = *pstates;
+		memset(&cc->cstates.arena, 0, sizeof(cc->cstates.arena));
+		cc->cstates.wakeinfo.irqinfo = NULL;
+		cc->cstates.wakeirq = NULL;
+		cc->pstates.pstate = NULL;
+		cc->wakeirq = cstates->wakeirq ?
+			cstates->wakeirq - cstates->wakeinfo.irqinfo : -1;
+
+		for (i = 0; i < MAXCSTATE; i++) {
+			struct cpuidle_cstate *c = &cstates->cstate[i];
+			char name[NAMELEN + 1] = { 0 };
+
+			cc->cstates.cstate[i].name = NULL;
+			cc->cstates.cstate[i].data = NULL;
+			cc->cstates.cstate[i].nrchunks = 0;
+			cc->cstates.cstate[i].compact = 0;
+			cc->cstates.cstate[i].packs = NULL;
+			cc->cstates.cstate[i].last_pack = NULL;
+			cc->cstates.cstate[i].open = 0;
+
+			if (c->name) {
+				strncpy(name, c->name, NAMELEN);
+				cc->names[i] = cache_write(f, name, sizeof(name));
+			}
+			cc->data[i] = cache_write_data(f, c,
+				i == cstates->last_cstate, buf);
+		}
+
+		cc->irqinfo = cache_write(f, cstates->wakeinfo.irqinfo,
+					  cstates->wakeinfo.nrdata *
+					  sizeof(*cstates->wakeinfo.irqinfo));
+		if (pstates->pstate)
+			cc->pstate = cache_write(f, pstates->pstate,
+						 pstates->max *
+						 sizeof(*pstates->pstate));
+	}
+
+	rewind(f);
+	fwrite(&header, sizeof(header), 1, f);
+	fseeko(f, header.cpus, SEEK_SET);
+	fwrite(ccs, sizeof(*ccs), datas->nrcpus, f);
+
+	ret = ferror(f);
+	if (fclose(f))
+		ret = -1;
+	f = NULL;
+	if (ret) {
+		ret = -1;
+		unlink(tmppath);
+		goto out;
+	}
+
+	/* readers never see a partial cache */
+	if (rename(tmppath, cpath)) {
+		unlink(tmppath);
+		goto out;
+	}
+
+	ret = 0;
+out:
+	if (f) {
+		fclose(f);
+		unlink(tmppath);
+	}
+	free(tmppath);
+	free(cpath);
+	free(topo);
+	free(buf);
+	free(ccs);
+
+	return ret;
+}
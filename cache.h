@@ -0,0 +1,55 @@
+/*
+ *  cache.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __CACHE_H
+#define __CACHE_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "idlestat.h"
+#include "import.h"
+
+/* the cache of a trace is stored next to it, under this suffix */
+#define CACHE_SUFFIX ".idlestat-cache"
+
+/* what the files derived from a trace are checked against */
+struct cache_key {
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t hash;
+};
+
+extern int cache_key(const char *path, struct cache_key *key);
+extern int cache_key_stat(const char *path, const struct stat *s,
+			  size_t size, struct cache_key *key);
+
+extern struct cpuidle_datas *cache_load(const char *path,
+					struct import_stats *stats);
+extern struct cpuidle_datas *cache_resume(const char *path,
+					  struct import_stats *stats,
+					  size_t *offset);
+extern int cache_store(const char *path, const struct cache_key *key,
+		       struct cpuidle_datas *datas, struct import_stats *stats,
+		       size_t offset);
+
+#endif
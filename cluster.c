@@ -0,0 +1,325 @@
+/*
+ *  cluster.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cluster.h"
+#include "interval.h"
+#include "utils.h"
+
+/**
+ * cluster_tracker_create - prepare to follow the C-states of the groups
+ * @nrcpus: number of CPUs of the trace
+ * @at_least: a group is in a C-state while its CPUs are in it or deeper
+ *
+ * Return: the tracker, without group, or NULL if out of memory
+ */
+struct cluster_tracker *cluster_tracker_create(int nrcpus, int at_least)
+{
+	struct cluster_tracker *t;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	t->groups = calloc(nrcpus, sizeof(*t->groups));
+	t->state = malloc(nrcpus * sizeof(*t->state));
+	t->entered = calloc(nrcpus, sizeof(*t->entered));
+	if (!t->groups || !t->state || !t->entered) {
+		free(t->groups);
+		free(t->state);
+		free(t->entered);
+		free(t);
+		return NULL;
+	}
+
+	memset(t->state, -1, nrcpus * sizeof(*t->state));
+	t->nrcpus = nrcpus;
+	t->at_least = at_least;
+
+	return t;
+}
+
+/**
+ * cluster_group_create - add a group of CPUs to the tracker
+ * @t: the tracker
+ * @level: the level of the group in the topology
+ * @cpus: the CPUs of the group
+ * @nrcpus: number of CPUs
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int cluster_group_create(struct cluster_tracker *t, int level,
+			 const int *cpus, int nrcpus)
+{
+	struct cluster_group *g, **all;
+	int i;
+
+	for (i = 0; i < nrcpus; i++)
+		if (cpus[i] < 0 || cpus[i] >= t->nrcpus ||
+		    t->groups[cpus[i]][level])
+			return -1;
+
+	all = realloc(t->all, (t->nrgroups + 1) * sizeof(*all));
+	if (!all)
+		return -1;
+	t->all = all;
+
+	g = calloc(1, sizeof(*g));
+	if (!g)
+		return -1;
+
+	g->cstates = aligned_calloc(1, sizeof(*g->cstates));
+	g->cpus = malloc(nrcpus * sizeof(*g->cpus));
+	if (!g->cstates || !g->cpus) {
+		free(g->cstates);
+		free(g->cpus);
+		free(g);
+		return -1;
+	}
+
+	for (i = 0; i < MAXCSTATE; i++)
+		g->cstates->cstate[i].min_time = UINT64_MAX;
+	g->cstates->last_cstate = -1;
+	g->cstates->cstate_max = -1;
+
+	memcpy(g->cpus, cpus, nrcpus * sizeof(*g->cpus));
+	g->nrcpus = nrcpus;
+
+	for (i = 0; i < nrcpus; i++)
+		t->groups[cpus[i]][level] = g;
+	t->all[t->nrgroups++] = g;
+
+	return 0;
+}
+
+/* the CPUs of the group in @state since before @time */
+static int cluster_group_idle_since(struct cluster_tracker *t,
+				    struct cluster_group *g, int state,
+				    uint64_t time)
+{
+	int i, cpu, n = 0;
+
+	for (i = 0; i < g->nrcpus; i++) {
+		cpu = g->cpus[i];
+		if ((t->at_least ? t->state[cpu] >= state :
+				   t->state[cpu] == state) &&
+		    t->entered[cpu] < time)
+			n++;
+	}
+
+	return n;
+}
+
+/* account the first intervals of the queue whose CPUs all closed theirs */
+static void cluster_group_flush(struct cluster_tracker *t,
+				struct cluster_group *g, int state)
+{
+	struct cluster_queue *q = &g->queue[state];
+	struct cpuidle_data *data;
+
+	do {
+		data = &q->data[q->head];
+		cstate_account(&g->cstates->cstate[state],
+			       data->end - data->begin);
+		q->head++;
+		if (!--q->count)
+			break;
+
+		q->left = cluster_group_idle_since(t, g, state,
+						   q->data[q->head].end);
+	} while (!q->left);
+}
+
+/**
+ * cluster_group_close - end the interval of a group in a C-state
+ * @t: the tracker
+ * @g: the group
+ * @state: the C-state one of its CPUs just left
+ * @time: the exit time
+ *
+ * The interval is accounted once the other CPUs have closed theirs.
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int cluster_group_close(struct cluster_tracker *t, struct cluster_group *g,
+			int state, uint64_t time)
+{
+	struct cluster_queue *q = &g->queue[state];
+	struct cpuidle_data *data;
+
+	if (q->head + q->count == q->size) {
+		if (q->head) {
+			memmove(q->data, &q->data[q->head],
+				q->count * sizeof(*q->data));
+		} else {
+			data = realloc(q->data, MAX(2 * q->size, 16) *
+				       sizeof(*q->data));
+			if (!data)
+				return -1;
+			q->data = data;
+			q->size = MAX(2 * q->size, 16);
+		}
+		q->head = 0;
+	}
+
+	data = &q->data[q->head + q->count];
+	data->begin = g->begin[state];
+	data->end = time;
+
+	/* the other CPUs are all still in the C-state */
+	if (!q->count++) {
+		q->left = g->idle[state];
+		if (!q->left)
+			cluster_group_flush(t, g, state);
+	}
+
+	return 0;
+}
+
+/**
+ * cluster_group_resolve - a CPU of a group closes its interval
+ * @t: the tracker
+ * @g: the group
+ * @state: the C-state of the queue
+ * @entered: when the CPU entered the C-state
+ */
+void cluster_group_resolve(struct cluster_tracker *t, struct cluster_group *g,
+			   int state, uint64_t entered)
+{
+	struct cluster_queue *q = &g->queue[state];
+
+	/* the CPU was not idle yet at the end of the first interval */
+	if (entered >= q->data[q->head].end || --q->left)
+		return;
+
+	cluster_group_flush(t, g, state);
+}
+
+/**
+ * cluster_group_drop - a CPU of a group leaves an interval which is
+ * never closed
+ * @g: the group
+ * @state: the C-state of the queue
+ * @entered: when the CPU entered the C-state
+ *
+ * The intervals of the group ending after @entered needed the one of
+ * the CPU, they are dropped too.
+ */
+void cluster_group_drop(struct cluster_group *g, int state, uint64_t entered)
+{
+	struct cluster_queue *q = &g->queue[state];
+
+	while (q->count && q->data[q->head + q->count - 1].end > entered)
+		q->count--;
+}
+
+/**
+ * cluster_cstate_name - name a C-state of a group
+ * @name: the name of the C-state of the CPUs
+ * @at_least: the C-state of the group covers the deeper ones too
+ *
+ * Return: the name, to be freed, or NULL if out of memory
+ */
+char *cluster_cstate_name(const char *name, int at_least)
+{
+	char *s;
+
+	if (!at_least)
+		return strdup(name);
+
+	if (asprintf(&s, ">=%s", name) < 0)
+		return NULL;
+
+	return s;
+}
+
+/**
+ * cluster_group_take - get the C-states of a group once the trace is
+ * imported
+ * @t: the tracker
+ * @level: the level of the group
+ * @cpu: one of the CPUs of the group
+ * @datas: the per-CPU statistics
+ *
+ * The names and the deepest C-state of the group come from its CPUs.
+ * The intervals still waiting for a CPU are dropped, its interval is
+ * never closed. The caller owns the result.
+ *
+ * Return: the C-states or NULL if there is no such group
+ */
+struct cpuidle_cstates *cluster_group_take(struct cluster_tracker *t,
+					   int level, int cpu,
+					   struct cpuidle_datas *datas)
+{
+	struct cluster_group *g;
+	struct cpuidle_cstates *cstates;
+	struct cpuidle_cstate *c;
+	int i;
+
+	if (cpu < 0 || cpu >= t->nrcpus)
+		return NULL;
+
+	g = t->groups[cpu][level];
+	if (!g || !g->cstates)
+		return NULL;
+
+	cstates = g->cstates;
+	g->cstates = NULL;
+
+	for (i = 0; i < g->nrcpus; i++)
+		cstates->cstate_max = MAX(cstates->cstate_max,
+					  datas->cstates[g->cpus[i]].cstate_max);
+
+	for (i = 0; i < cstates->cstate_max + 1; i++) {
+		c = &cstates->cstate[i];
+		c->name = cluster_cstate_name(
+			datas->cstates[g->cpus[0]].cstate[i].name, t->at_least);
+		c->avg_time = c->nrdata ? c->duration / c->nrdata : 0;
+	}
+
+	return cstates;
+}
+
+void cluster_tracker_release(struct cluster_tracker *t)
+{
+	int i, k;
+
+	if (!t)
+		return;
+
+	for (i = 0; i < t->nrgroups; i++) {
+		for (k = 0; k < MAXCSTATE; k++)
+			free(t->all[i]->queue[k].data);
+		free(t->all[i]->cstates);
+		free(t->all[i]->cpus);
+		free(t->all[i]);
+	}
+
+	free(t->all);
+	free(t->groups);
+	free(t->state);
+	free(t->entered);
+	free(t);
+}
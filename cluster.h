@@ -0,0 +1,155 @@
+/*
+ *  cluster.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __CLUSTER_H
+#define __CLUSTER_H
+
+#include <stdint.h>
+
+#include "idlestat.h"
+
+/*
+ * The C-states of the cores and the clusters can be followed while the
+ * events are stored, instead of intersecting the intervals of their CPUs
+ * afterwards. A group is in a C-state when all its CPUs are: it counts
+ * its CPUs in each state and accounts an interval when the count drops
+ * from full. The events must be stored in time order, and nothing but
+ * the statistics of the group is kept. With --at-least, a CPU in a state
+ * is counted in all the shallower ones too.
+ *
+ * Like the intersection of the intervals, a group interval only counts
+ * once the CPUs still idle at its end have closed theirs: it waits in a
+ * queue until then, and is dropped with the interval of a CPU which is
+ * never closed, because events were lost or the trace ends.
+ */
+enum cluster_level {
+	CLUSTER_CORE = 0,	/* the threads of a core */
+	CLUSTER_PACKAGE,	/* all the CPUs of a cluster, at --level */
+	CLUSTER_LEVELS
+};
+
+/* the group intervals of a C-state waiting for their CPUs, by end */
+struct cluster_queue {
+	struct cpuidle_data *data;
+	int head;
+	int count;
+	int size;
+	int left;		/* CPUs still idle since the end of the
+				 * first one */
+};
+
+struct cluster_group {
+	struct cpuidle_cstates *cstates;	/* the statistics */
+	int *cpus;
+	int nrcpus;
+	int idle[MAXCSTATE];		/* CPUs of the group in each C-state,
+					 * or in it or deeper */
+	uint64_t begin[MAXCSTATE];	/* when the last of them entered it */
+	struct cluster_queue queue[MAXCSTATE];
+};
+
+struct cluster_tracker {
+	int nrcpus;
+	int at_least;		/* count the CPUs at least as deep */
+	struct cluster_group *(*groups)[CLUSTER_LEVELS];	/* per CPU */
+	struct cluster_group **all;
+	int nrgroups;
+	int *state;		/* per CPU, -1 while it runs */
+	uint64_t *entered;	/* per CPU, when it entered its state */
+};
+
+extern struct cluster_tracker *cluster_tracker_create(int nrcpus,
+						     int at_least);
+extern int cluster_group_create(struct cluster_tracker *t, int level,
+				const int *cpus, int nrcpus);
+extern struct cpuidle_cstates *cluster_group_take(struct cluster_tracker *t,
+						  int level, int cpu,
+						  struct cpuidle_datas *datas);
+extern void cluster_tracker_release(struct cluster_tracker *t);
+
+extern int cluster_group_close(struct cluster_tracker *t,
+			       struct cluster_group *g, int state,
+			       uint64_t time);
+extern void cluster_group_resolve(struct cluster_tracker *t,
+				  struct cluster_group *g, int state,
+				  uint64_t entered);
+extern void cluster_group_drop(struct cluster_group *g, int state,
+			       uint64_t entered);
+extern char *cluster_cstate_name(const char *name, int at_least);
+
+/* @cpu enters @state, it was in @prev which was never closed if not -1 */
+static inline void cluster_idle_enter(struct cluster_tracker *t, int cpu,
+				      int state, int prev, uint64_t time)
+{
+	struct cluster_group *g;
+	int i, k;
+
+	for (i = 0; i < CLUSTER_LEVELS; i++) {
+		g = t->groups[cpu][i];
+		if (!g)
+			continue;
+
+		/* the interval left open is dropped, and so are the ones
+		 * of the group it took part in */
+		for (k = t->at_least ? 0 : prev; k >= 0 && k <= prev; k++) {
+			g->idle[k]--;
+			if (g->queue[k].count)
+				cluster_group_drop(g, k, t->entered[cpu]);
+		}
+
+		for (k = t->at_least ? 0 : state; k <= state; k++)
+			if (++g->idle[k] == g->nrcpus)
+				g->begin[k] = time;
+	}
+
+	t->state[cpu] = state;
+	t->entered[cpu] = time;
+}
+
+/* @cpu leaves @state, return 0 on success, -1 if out of memory */
+static inline int cluster_idle_exit(struct cluster_tracker *t, int cpu,
+				    int state, uint64_t time)
+{
+	struct cluster_group *g;
+	int i, k;
+
+	t->state[cpu] = -1;
+
+	for (i = 0; i < CLUSTER_LEVELS; i++) {
+		g = t->groups[cpu][i];
+		if (!g)
+			continue;
+
+		for (k = t->at_least ? 0 : state; k <= state; k++) {
+			if (g->queue[k].count)
+				cluster_group_resolve(t, g, k,
+						      t->entered[cpu]);
+
+			if (g->idle[k]-- == g->nrcpus && g->begin[k] < time &&
+			    cluster_group_close(t, g, k, time))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+#endif
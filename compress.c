@@ -0,0 +1,162 @@
+/*
+ *  compress.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "compress.h"
+
+/* size of the pipe to the filter, so a read gets a large block */
+#define COMPRESS_PIPE_SIZE (1 << 20)
+
+static const struct compressor compressors[] = {
+	{ "gzip", "\x1f\x8b", 2, ".gz" },
+	{ "zstd", "\x28\xb5\x2f\xfd", 4, ".zst" },
+	{ "xz", "\xfd" "7zXZ", 6, ".xz" },
+	{ NULL },
+};
+
+/**
+ * compressor_match - find the compression of a file from its content
+ * @data: the beginning of the file
+ * @len: the length of @data
+ *
+ * Return: the compressor or NULL if the file is not compressed
+ */
+const struct compressor *compressor_match(const char *data, size_t len)
+{
+	const struct compressor *c;
+
+	for (c = compressors; c->name; c++)
+		if (len >= c->magic_len && !memcmp(data, c->magic, c->magic_len))
+			return c;
+
+	return NULL;
+}
+
+/**
+ * compressor_for_path - find the compression of a file from its name
+ * @path: the file name
+ *
+ * Return: the compressor or NULL if the name has no known suffix
+ */
+const struct compressor *compressor_for_path(const char *path)
+{
+	const struct compressor *c;
+	size_t len = strlen(path);
+
+	for (c = compressors; c->name; c++)
+		if (len > strlen(c->suffix) &&
+		    !strcmp(path + len - strlen(c->suffix), c->suffix))
+			return c;
+
+	return NULL;
+}
+
+/**
+ * compressor_spawn - run a compression tool as a filter
+ * @c: the compressor
+ * @decompress: read the compressed data from @fd rather than write it
+ * @fd: the compressed file, the filter reads it when decompressing and
+ *      writes it when compressing
+ * @pid: filled with the pid of the filter
+ *
+ * Return: the end of the pipe to read the decompressed data from, or
+ * to write the data to compress to, -1 on error
+ */
+int compressor_spawn(const struct compressor *c, int decompress, int fd,
+		     pid_t *pid)
+{
+	int fds[2];
+
+	if (pipe2(fds, O_CLOEXEC)) {
+		fprintf(stderr, "%s: failed to create a pipe: %m\n", __func__);
+		return -1;
+	}
+
+	/* best effort, the filter works with the default size as well */
+	fcntl(fds[0], F_SETPIPE_SZ, COMPRESS_PIPE_SIZE);
+
+	*pid = fork();
+	if (*pid < 0) {
+		fprintf(stderr, "%s: failed to fork: %m\n", __func__);
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+
+	if (!*pid) {
+		if (decompress) {
+			dup2(fd, STDIN_FILENO);
+			dup2(fds[1], STDOUT_FILENO);
+		} else {
+			dup2(fds[0], STDIN_FILENO);
+			dup2(fd, STDOUT_FILENO);
+		}
+
+		execlp(c->name, c->name, decompress ? "-dc" : "-c", NULL);
+		fprintf(stderr, "%s: failed to run %s: %m\n", __func__, c->name);
+		_exit(127);
+	}
+
+	if (decompress) {
+		close(fds[1]);
+		return fds[0];
+	}
+
+	close(fds[0]);
+	return fds[1];
+}
+
+/**
+ * compressor_wait - wait for a filter to finish, its end of the pipe
+ * must be closed first
+ * @c: the compressor
+ * @pid: the pid of the filter
+ *
+ * Return: 0 if the filter succeeded, -1 otherwise
+ */
+int compressor_wait(const struct compressor *c, pid_t pid)
+{
+	int status;
+
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR)
+			return -1;
+
+	if (WIFEXITED(status) && !WEXITSTATUS(status))
+		return 0;
+
+	/* the reader stopped before the end of the data */
+	if (WIFSIGNALED(status) && WTERMSIG(status) == SIGPIPE)
+		return 0;
+
+	fprintf(stderr, "%s: %s failed\n", __func__, c->name);
+
+	return -1;
+}
@@ -0,0 +1,46 @@
+/*
+ *  compress.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __COMPRESS_H
+#define __COMPRESS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * The compressed traces are read and written through the external
+ * compression tools, running as a filter at the other end of a pipe.
+ */
+struct compressor {
+	const char *name;	/* the tool, it must accept -c and -d */
+	const char *magic;
+	size_t magic_len;
+	const char *suffix;
+};
+
+extern const struct compressor *compressor_match(const char *data,
+						 size_t len);
+extern const struct compressor *compressor_for_path(const char *path);
+extern int compressor_spawn(const struct compressor *c, int decompress,
+			    int fd, pid_t *pid);
+extern int compressor_wait(const struct compressor *c, pid_t pid);
+
+#endif
@@ -33,7 +33,6 @@
 #include <unistd.h>
 #include <sched.h>
 #include <string.h>
-#include <float.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
@@ -47,11 +46,21 @@
 #include "trace.h"
 #include "list.h"
 #include "topology.h"
+#include "tracefile.h"
+#include "parser.h"
+#include "import.h"
+#include "pipeline.h"
+#include "tracedat.h"
+#include "compress.h"
+#include "cache.h"
+#include "index.h"
+#include "shard.h"
+#include "interval.h"
+#include "cluster.h"
+#include "spill.h"
 
 #define IDLESTAT_VERSION "0.4-rc1"
-#define USEC_PER_SEC 1000000
-
-static char buffer[BUFSIZE];
+#define NSEC_PER_USEC 1000
 
 /* I happen to agree with David Wheeler's assertion that Unix filenames
  * are too flexible. Eliminate some of the madness.
@@ -128,15 +137,16 @@ static void display_cpu_header(char *cpu, int length)
 	charrep('-', length);
 	printf("\n");
 
-	if (strstr(cpu, "cluster"))
-		printf("| %-*s |\n", length - 4, cpu);
-	else if (strstr(cpu, "core"))
+	if (!strncmp(cpu, "cpu", 3))
+		printf("|             %-*s |\n", length - 16, cpu);
+	else if (!strncmp(cpu, "core", 4))
 		printf("|      %-*s |\n", length - 9, cpu);
-	else printf("|             %-*s |\n", length - 16, cpu);
+	else printf("| %-*s |\n", length - 4, cpu);
 }
 
-static void display_factored_time(double time, int align)
+static void display_factored_time(uint64_t ns, int align)
 {
+	double time = (double)ns / NSEC_PER_USEC;
 	char buffer[128];
 
 	if (time < 1000) {
@@ -204,7 +214,7 @@ static int display_cstates(void *arg, char *cpu)
 		}
 
 		printf("| %8s | ", c->name);
-		display_factored_time(c->min_time == DBL_MAX ? 0. :
+		display_factored_time(c->min_time == UINT64_MAX ? 0 :
 				      c->min_time, 8);
 		printf(" | ");
 		display_factored_time(c->max_time, 8);
@@ -260,7 +270,7 @@ static int display_pstates(void *arg, char *cpu)
 		printf("| ");
 		display_factored_freq(p->freq, 8);
 		printf(" | ");
-		display_factored_time(p->min_time == DBL_MAX ? 0. :
+		display_factored_time(p->min_time == UINT64_MAX ? 0 :
 				      p->min_time, 8);
 		printf(" | ");
 		display_factored_time(p->max_time, 8);
@@ -321,94 +331,81 @@ static int display_wakeup(void *arg, char *cpu)
 	return 0;
 }
 
-static struct cpuidle_data *intersection(struct cpuidle_data *data1,
-					 struct cpuidle_data *data2)
+static void display_concurrency_header(void)
 {
-	double begin, end;
-	struct cpuidle_data *data;
-
-	begin = MAX(data1->begin, data2->begin);
-	end = MIN(data1->end, data2->end);
-
-	if (begin >= end)
-		return NULL;
-
-	data = malloc(sizeof(*data));
-	if (!data)
-		return NULL;
-
-	data->begin = begin;
-	data->end = end;
-	data->duration = end - begin;
-	data->duration *= USEC_PER_SEC;
+	charrep('-', 35);
+	printf("\n");
 
-	return data;
+	printf("| idle CPUs |   total  |   share  |\n");
 }
 
-static struct cpuidle_cstate *inter(struct cpuidle_cstate *c1,
-				    struct cpuidle_cstate *c2)
+static void display_concurrency_footer(void)
 {
-	int i, j;
-	struct cpuidle_data *interval;
-	struct cpuidle_cstate *result;
-	struct cpuidle_data *data = NULL;
-	size_t index;
+	charrep('-', 35);
+	printf("\n\n");
+}
 
-	if (!c1)
-		return c2;
-	if (!c2)
-		return c1;
+static int display_concurrency(void *arg, char *cpu)
+{
+	struct idle_concurrency *g = arg;
+	uint64_t span = 0;
+	int k;
 
-	result = calloc(sizeof(*result), 1);
-	if (!result)
-		return NULL;
+	for (k = 0; k <= g->nrcpus; k++)
+		span += g->time[k];
 
-	for (i = 0, index = 0; i < c1->nrdata; i++) {
+	if (!span)
+		/* nothing to report for this cluster */
+		return 0;
 
-		for (j = index; j < c2->nrdata; j++) {
-			struct cpuidle_data *tmp;
+	display_cpu_header(cpu, 35);
+	charrep('-', 35);
+	printf("\n");
 
-			/* intervals are ordered, no need to go further */
-			if (c1->data[i].end < c2->data[j].begin)
-				break;
+	for (k = 0; k <= g->nrcpus; k++) {
+		if (!g->time[k])
+			continue;
 
-			/* primary loop begins where we ended */
-			if (c1->data[i].begin > c2->data[j].end)
-				index = j;
+		printf("| %9d | ", k);
+		display_factored_time(g->time[k], 8);
+		printf(" | %7.2f%% |\n", 100.0 * g->time[k] / span);
+	}
 
-			interval = intersection(&c1->data[i], &c2->data[j]);
-			if (!interval)
-				continue;
+	return 0;
+}
 
-			result->min_time = MIN(result->min_time,
-					       interval->duration);
+/*
+ * The C-state of a group of CPUs, a core or a cluster, holds the
+ * intervals where all of them were in that state. A single CPU is its
+ * own group.
+ */
+static struct cpuidle_cstate *inter(struct cpuidle_cstate **cs, int n,
+				    struct arena *arena)
+{
+	struct cpuidle_cstate *result;
+	struct interval_summary s;
 
-			result->max_time = MAX(result->max_time,
-					       interval->duration);
+	if (n <= 1)
+		return n ? cs[0] : NULL;
 
-			result->avg_time = AVG(result->avg_time,
-					       interval->duration,
-					       result->nrdata + 1);
+	result = arena_alloc(arena, sizeof(*result));
+	if (!result)
+		return NULL;
 
-			result->duration += interval->duration;
+	/* the result is stored like the intervals it comes from */
+	result->compact = cs[0]->compact;
 
-			result->nrdata++;
+	if (cstate_intersect(result, cs, n, arena))
+		return NULL;
 
-			tmp = realloc(data, sizeof(*data) *
-				       (result->nrdata + 1));
-			if (!tmp) {
-				free(data);
-				free(result);
-				return NULL;
-			}
-			data = tmp;
+	/* the target residencies are the ones of the CPUs, the wakeups of
+	 * a group are not checked against them */
+	cstate_summarize(result, INT64_MIN, INT64_MAX, &s);
 
-			result->data = data;
-			result->data[result->nrdata - 1] = *interval;
-
-			free(interval);
-		}
-	}
+	result->min_time = s.min;
+	result->max_time = s.max;
+	result->duration = s.sum;
+	result->avg_time = s.count ? s.sum / s.count : 0;
 
 	return result;
 }
@@ -439,6 +436,17 @@ static char *cpuidle_cstate_name(int cpu, int state)
 	return name;
 }
 
+/* the trace may come from another host, or the CPU be offline here */
+static char *cstate_name(int cpu, int state)
+{
+	char *name = cpuidle_cstate_name(cpu, state);
+
+	if (!name && asprintf(&name, "C%d", state) < 0)
+		return NULL;
+
+	return name;
+}
+
 
 /**
  * release_cstate_info - free all C-state related structs
@@ -453,13 +461,14 @@ static void release_cstate_info(struct cpuidle_cstates *cstates, int nrcpus)
 		/* already cleaned up */
 		return;
 
-	/* free C-state names */
+	/* free C-state names and intervals */
 	for (cpu = 0; cpu < nrcpus; cpu++) {
 		for (i = 0; i < MAXCSTATE; i++) {
 			struct cpuidle_cstate *c = &(cstates[cpu].cstate[i]);
 			if (c->name)
 				free(c->name);
 		}
+		arena_release(&cstates[cpu].arena);
 	}
 
 	/* free the cstates array */
@@ -499,18 +508,18 @@ int cpuidle_get_target_residency(int cpu, int state)
  * build_cstate_info - parse cpuidle sysfs entries and build per-CPU
  * structs to maintain statistics of C-state transitions
  * @nrcpus: number of CPUs
+ * @compact: pack the idle intervals instead of storing them in chunks
  *
  * Return: per-CPU array of structs (success) or NULL (error)
  */
-static struct cpuidle_cstates *build_cstate_info(int nrcpus)
+static struct cpuidle_cstates *build_cstate_info(int nrcpus, int compact)
 {
 	int cpu;
 	struct cpuidle_cstates *cstates;
 
-	cstates = calloc(nrcpus, sizeof(*cstates));
+	cstates = aligned_calloc(nrcpus, sizeof(*cstates));
 	if (!cstates)
 		return NULL;
-	memset(cstates, 0, sizeof(*cstates) * nrcpus);
 
 	/* initialize cstate_max for each cpu */
 	for (cpu = 0; cpu < nrcpus; cpu++) {
@@ -521,14 +530,16 @@ static struct cpuidle_cstates *build_cstate_info(int nrcpus)
 		cstates[cpu].last_cstate = -1;
 		for (i = 0; i < MAXCSTATE; i++) {
 			c = &(cstates[cpu].cstate[i]);
-			c->name = cpuidle_cstate_name(cpu, i);
+			c->name = cstate_name(cpu, i);
 			c->data = NULL;
+			c->nrchunks = 0;
+			c->compact = compact;
 			c->nrdata = 0;
 			c->premature_wakeup = 0;
-			c->avg_time = 0.;
-			c->max_time = 0.;
-			c->min_time = DBL_MAX;
-			c->duration = 0.;
+			c->avg_time = 0;
+			c->max_time = 0;
+			c->min_time = UINT64_MAX;
+			c->duration = 0;
 			c->target_residency =
 				cpuidle_get_target_residency(cpu, i);
 		}
@@ -572,10 +583,9 @@ static struct cpufreq_pstates *build_pstate_info(int nrcpus)
 	int cpu;
 	struct cpufreq_pstates *pstates;
 
-	pstates = calloc(nrcpus, sizeof(*pstates));
+	pstates = aligned_calloc(nrcpus, sizeof(*pstates));
 	if (!pstates)
 		return NULL;
-	memset(pstates, 0, sizeof(*pstates) * nrcpus);
 
 	for (cpu = 0; cpu < nrcpus; cpu++) {
 		struct cpufreq_pstate *pstate;
@@ -616,10 +626,10 @@ static struct cpufreq_pstates *build_pstate_info(int nrcpus)
 			pstate[nrfreq].id = nrfreq;
 			pstate[nrfreq].freq = atol(freq);
 			pstate[nrfreq].count = 0;
-			pstate[nrfreq].min_time = DBL_MAX;
-			pstate[nrfreq].max_time = 0.;
-			pstate[nrfreq].avg_time = 0.;
-			pstate[nrfreq].duration = 0.;
+			pstate[nrfreq].min_time = UINT64_MAX;
+			pstate[nrfreq].max_time = 0;
+			pstate[nrfreq].avg_time = 0;
+			pstate[nrfreq].duration = 0;
 			nrfreq++;
 			freq = NULL;
 		}
@@ -629,8 +639,8 @@ static struct cpufreq_pstates *build_pstate_info(int nrcpus)
 		pstates[cpu].max = nrfreq;
 		pstates[cpu].current = -1;	/* unknown */
 		pstates[cpu].idle = -1;		/* unknown */
-		pstates[cpu].time_enter = 0.;
-		pstates[cpu].time_exit = 0.;
+		pstates[cpu].time_enter = 0;
+		pstates[cpu].time_exit = 0;
 	}
 
 	return pstates;
@@ -670,12 +680,13 @@ static int freq_to_pstate_index(struct cpufreq_pstates *ps, unsigned int freq)
 	return i >= ps->max ? -1 : ps->pstate[i].id;
 }
 
-static void open_current_pstate(struct cpufreq_pstates *ps, double time)
+static void open_current_pstate(struct cpufreq_pstates *ps, uint64_t time)
 {
 	ps->time_enter = time;
 }
 
-static void open_next_pstate(struct cpufreq_pstates *ps, int s, double time)
+static void open_next_pstate(struct cpufreq_pstates *ps, int s,
+			     uint64_t time)
 {
 	ps->current = s;
 	if (ps->idle) {
@@ -685,26 +696,26 @@ static void open_next_pstate(struct cpufreq_pstates *ps, int s, double time)
 	open_current_pstate(ps, time);
 }
 
-static void close_current_pstate(struct cpufreq_pstates *ps, double time)
+static void close_current_pstate(struct cpufreq_pstates *ps, uint64_t time)
 {
 	int c = ps->current;
 	struct cpufreq_pstate *p = &(ps->pstate[c]);
-	double elapsed;
+	uint64_t elapsed;
 
 	if (ps->idle) {
 		fprintf(stderr, "warning: closing P-state on idle CPU\n");
 		return;
 	}
-	elapsed = (time - ps->time_enter) * USEC_PER_SEC;
+	elapsed = time - ps->time_enter;
 	p->min_time = MIN(p->min_time, elapsed);
 	p->max_time = MAX(p->max_time, elapsed);
-	p->avg_time = AVG(p->avg_time, elapsed, p->count + 1);
 	p->duration += elapsed;
 	p->count++;
+	p->avg_time = p->duration / p->count;
 }
 
 static void cpu_change_pstate(struct cpuidle_datas *datas, int cpu,
-			      unsigned int freq, double time)
+			      unsigned int freq, uint64_t time)
 {
 	struct cpufreq_pstates *ps;
 	struct cpufreq_pstate *p;
@@ -742,7 +753,8 @@ static void cpu_change_pstate(struct cpuidle_datas *datas, int cpu,
 	}
 }
 
-static void cpu_pstate_idle(struct cpuidle_datas *datas, int cpu, double time)
+static void cpu_pstate_idle(struct cpuidle_datas *datas, int cpu,
+			    uint64_t time)
 {
 	struct cpufreq_pstates *ps = &(datas->pstates[cpu]);
 	if (ps->current != -1)
@@ -751,7 +763,7 @@ static void cpu_pstate_idle(struct cpuidle_datas *datas, int cpu, double time)
 }
 
 static void cpu_pstate_running(struct cpuidle_datas *datas, int cpu,
-			       double time)
+			       uint64_t time)
 {
 	struct cpufreq_pstates *ps = &(datas->pstates[cpu]);
 	ps->idle = 0;
@@ -759,69 +771,86 @@ static void cpu_pstate_running(struct cpuidle_datas *datas, int cpu,
 		open_current_pstate(ps, time);
 }
 
-static int store_data(double time, int state, int cpu,
+/**
+ * cstate_update_stats - compute the statistics of a C-state from its
+ * intervals
+ * @cstates: the C-states of a CPU
+ * @state: the C-state
+ *
+ * A wakeup is premature when the CPU stayed idle less than the target
+ * residency of the state, and the CPU could have slept more when it
+ * stayed long enough for the next state. The target residencies can be
+ * changed and the statistics computed again without parsing the trace.
+ */
+static void cstate_update_stats(struct cpuidle_cstates *cstates, int state)
+{
+	struct cpuidle_cstate *c = &cstates->cstate[state];
+	struct interval_summary s;
+	int64_t low, high = INT64_MAX;
+	int next;
+
+	/* the target residencies are in us, -1 if not available */
+	low = (int64_t)c->target_residency * NSEC_PER_USEC;
+
+	next = state + 1 <= cstates->cstate_max ? state + 1 : 0;
+	if (next > 0 && cstates->cstate[next].target_residency > 0)
+		high = (int64_t)cstates->cstate[next].target_residency *
+			NSEC_PER_USEC;
+
+	cstate_summarize(c, low, high, &s);
+
+	c->min_time = s.min;
+	c->max_time = s.max;
+	c->duration = s.sum;
+	c->avg_time = s.count ? s.sum / s.count : 0;
+	c->premature_wakeup = s.below;
+	c->could_sleep_more = s.above;
+}
+
+/**
+ * update_cstate_stats - compute the statistics of all the C-states
+ * @datas: the per-CPU statistics
+ */
+static void update_cstate_stats(struct cpuidle_datas *datas)
+{
+	int cpu, i;
+
+	for (cpu = 0; cpu < datas->nrcpus; cpu++)
+		for (i = 0; i <= datas->cstates[cpu].cstate_max; i++)
+			cstate_update_stats(&datas->cstates[cpu], i);
+}
+
+static int store_data(uint64_t time, int state, int cpu,
 		      struct cpuidle_datas *datas, int count)
 {
 	struct cpuidle_cstates *cstates = &datas->cstates[cpu];
 	struct cpufreq_pstate *pstate = datas->pstates[cpu].pstate;
 	struct cpuidle_cstate *cstate;
-	struct cpuidle_data *data, *tmp;
-	int nrdata, last_cstate = cstates->last_cstate;
-	int next_cstate;
+	struct cpuidle_data data;
+	int last_cstate = cstates->last_cstate;
 
-	/* ignore when we got a "closing" state first */
-	if (state == -1 && cstates->cstate_max == -1)
+	/* ignore when we got a "closing" state first, or twice in a
+	 * row in a trace where events were lost */
+	if (state == -1 && (cstates->cstate_max == -1 || last_cstate == -1))
 		return 0;
 
 	cstate = &cstates->cstate[state == -1 ? last_cstate : state];
-	data = cstate->data;
-	nrdata = cstate->nrdata;
 
 	if (state == -1) {
 
-		data = &data[nrdata];
-
-		data->end = time;
-		data->duration = data->end - data->begin;
-
-		/* That happens when precision digit in the file exceed
-		 * 7 (eg. xxx.1000000). Ignoring the result because I don't
-		 * find a way to fix with the sscanf used in the caller
-		 */
-		if (data->duration < 0)
-			return 0;
-
-		/* convert to us */
-		data->duration *= USEC_PER_SEC;
-		cstates->not_predicted = 0;
-		if (data->duration < cstate->target_residency) {
-			/* over estimated */
-			cstate->premature_wakeup++;
-			cstates->not_predicted = 1;
-		} else {
-			/* under estimated */
-			unsigned int tr;
-
-			next_cstate = ((last_cstate + 1) <= cstates->cstate_max)
-					? last_cstate + 1 : 0;
-			if (next_cstate > 0) {
-				tr = cstates->cstate[next_cstate].target_residency;
-				if ((tr > 0) && (data->duration >= tr))
-					cstate->could_sleep_more++;
-			}
-		}
-
-		cstate->min_time = MIN(cstate->min_time, data->duration);
+		if (cstate_close(cstate, time, &data, &cstates->arena))
+			return error("cstate_close");
 
-		cstate->max_time = MAX(cstate->max_time, data->duration);
+		/* the wakeup is attributed right away, the statistics of
+		 * the C-states are computed once all the intervals are
+		 * known, see cstate_update_stats() */
+		cstates->not_predicted = (int64_t)(data.end - data.begin) <
+			(int64_t)cstate->target_residency * NSEC_PER_USEC;
 
-
-		cstate->avg_time = AVG(cstate->avg_time, data->duration,
-				       cstate->nrdata + 1);
-
-		cstate->duration += data->duration;
-
-		cstate->nrdata++;
+		if (datas->clusters &&
+		    cluster_idle_exit(datas->clusters, cpu, last_cstate,
+				      data.end))
+			return error("cluster_idle_exit");
 
 		/* need indication if CPU is idle or not */
 		cstates->last_cstate = -1;
@@ -833,16 +862,13 @@ static int store_data(double time, int state, int cpu,
 		return 0;
 	}
 
-	tmp = realloc(data, sizeof(*data) * (nrdata + 1));
-	if (!tmp) {
-		free(data);
-		return error("realloc data");
-	}
-	data = tmp;
+	if (cstate_open(cstate, time, &cstates->arena))
+		return error("cstate_open");
 
-	data[nrdata].begin = time;
+	if (datas->clusters)
+		cluster_idle_enter(datas->clusters, cpu, state, last_cstate,
+				   time);
 
-	cstates->cstate[state].data = data;
 	cstates->cstate_max = MAX(cstates->cstate_max, state);
 	cstates->last_cstate = state;
 	cstates->wakeirq = NULL;
@@ -904,87 +930,161 @@ static int store_irq(int cpu, int irqid, char *irqname,
 	return 0;
 }
 
-#define TRACE_IRQ_FORMAT "%*[^[][%d] %*[^=]=%d%*[^=]=%16s"
-#define TRACE_IPIIRQ_FORMAT "%*[^[][%d] %*[^(](%32s"
-#define TRACECMD_REPORT_FORMAT "%*[^]]] %lf:%*[^=]=%u%*[^=]=%d"
-#define TRACE_FORMAT "%*[^]]] %*s %lf:%*[^=]=%u%*[^=]=%d"
-
-static int get_wakeup_irq(struct cpuidle_datas *datas, char *buffer, int count)
+int store_event(struct cpuidle_datas *datas, struct trace_event *ev, int count)
 {
-	int cpu, irqid;
-	char irqname[NAMELEN+1];
-
-	if (strstr(buffer, "irq_handler_entry")) {
-		assert(sscanf(buffer, TRACE_IRQ_FORMAT, &cpu, &irqid,
-			      irqname) == 3);
-
-		store_irq(cpu, irqid, irqname, datas, count, HARD_IRQ);
-		return 0;
-	}
+	uint64_t time = ev->time;
 
-	if (strstr(buffer, "ipi_entry")) {
-		assert(sscanf(buffer, TRACE_IPIIRQ_FORMAT, &cpu, irqname) == 2);
-		irqname[strlen(irqname) - 1] = '\0';
-		store_irq(cpu, -1, irqname, datas, count, IPI_IRQ);
+	switch (ev->type) {
+	case EVENT_CPU_IDLE:
+		/* a corrupted trace must not overflow the C-state table */
+		if ((int)ev->value != -1 && ev->value >= MAXCSTATE)
+			return -1;
+		return store_data(time, ev->value, ev->cpu, datas, count);
+	case EVENT_CPU_FREQUENCY:
+		assert(datas->pstates[ev->cpu].pstate != NULL);
+		cpu_change_pstate(datas, ev->cpu, ev->value, time);
 		return 0;
+	case EVENT_IRQ:
+		return store_irq(ev->cpu, ev->value, ev->name, datas, count,
+				 HARD_IRQ);
+	case EVENT_IPI:
+		return store_irq(ev->cpu, -1, ev->name, datas, count,
+				 IPI_IRQ);
 	}
 
 	return -1;
 }
 
+static inline bool line_has(const char *line, size_t len, const char *str)
+{
+	return memmem(line, len, str, strlen(str)) != NULL;
+}
+
+/* the intervals are stored in chunks, not with one allocation each */
+static void idlestat_arena_stats(struct cpuidle_datas *datas)
+{
+	struct arena usage = { 0 };
+	int cpu;
+
+	for (cpu = 0; cpu < datas->nrcpus; cpu++)
+		arena_usage(&usage, &datas->cstates[cpu].arena);
+	cpu_topo_arena_usage(&usage);
+
+	fprintf(stderr, "Intervals: %lu stored in %lu blocks, "
+		"%lu allocations avoided\n", usage.nritems, usage.nrblocks,
+		usage.nritems > usage.nrblocks ?
+		usage.nritems - usage.nrblocks : 0);
+}
+
+static void idlestat_log_stats(struct import_stats *stats)
+{
+	fprintf(stderr, "Log is %lf secs long with %zd events\n",
+		stats->count && stats->end > stats->begin ?
+		(double)(stats->end - stats->begin) / NSEC_PER_SEC : 0.,
+		stats->count);
+}
+
 static struct cpuidle_datas *idlestat_load(struct program_options *options)
 {
-	FILE *f;
-	unsigned int state = 0, freq = 0, cpu = 0, nrcpus = 0;
-	double time, begin = 0, end = 0;
-	size_t count = 0, start = 1;
+	struct trace_file *tf;
+	struct trace_event ev;
+	struct import_stats stats;
+	struct pipeline_stalls stalls;
+	struct trace_dat *td = NULL;
+	struct trace_index *index;
+	struct import_window window;
+	struct cache_key key;
+	bool windowed = options->from || options->to != UINT64_MAX;
+	bool nokey;
+	size_t offset;
+	int nrcpus = 0, nrshards = 0, failed = 0, ret;
 	struct cpuidle_datas *datas;
-	int ret;
+	char *line, *event;
+	size_t len;
+
+	/* the trace was imported before, the intervals of the cache are
+	 * used in place and can not be spilled */
+	if (!options->nocache && !windowed && !options->memory_limit) {
+		datas = cache_load(options->filename, &stats);
+		if (datas) {
+			idlestat_log_stats(&stats);
+			return datas;
+		}
+	}
 
-	f = fopen(options->filename, "r");
-	if (!f) {
-		fprintf(stderr, "%s: failed to open '%s': %m\n", __func__,
-					options->filename);
+	tf = trace_file_open(options->filename);
+	if (!tf)
 		return NULL;
+
+	/* the trace was appended to since it was imported, parse the new
+	 * lines only */
+	if (options->incremental && !options->nocache && !windowed &&
+	    !options->memory_limit && tf->map) {
+		datas = cache_resume(options->filename, &stats, &offset);
+		if (datas) {
+			nrcpus = datas->nrcpus;
+			trace_file_complete(tf);
+			trace_file_seek(tf, offset);
+			line = trace_file_getline(tf, &len);
+			goto resume;
+		}
 	}
 
 	/* version line */
-	fgets(buffer, BUFSIZE, f);
-	if (strstr(buffer, "idlestat")) {
+	line = trace_file_getline(tf, &len);
+	if (line && trace_dat_match(line, len)) {
+		options->format = TRACE_CMD_DAT;
+		td = trace_dat_open(tf);
+		if (!td) {
+			trace_file_close(tf);
+			return NULL;
+		}
+		nrcpus = trace_dat_nrcpus(td);
+		line = NULL;
+	} else if (line && line_has(line, len, "idlestat")) {
 		options->format = IDLESTAT_HEADER;
-		fgets(buffer, BUFSIZE, f);
-		assert(sscanf(buffer, "cpus=%u", &nrcpus) == 1);
-		fgets(buffer, BUFSIZE, f);
-	} else if (strstr(buffer, "# tracer")) {
+		line = trace_file_getline(tf, &len);
+		assert(line && !line_scan_int(line, len, "cpus=", &nrcpus));
+		line = trace_file_getline(tf, &len);
+	} else if (line && line_has(line, len, "# tracer")) {
 		options->format = TRACE_CMD_HEADER;
-		while(!feof(f)) {
-			if (buffer[0] != '#')
+		while (line) {
+			if (line[0] != '#')
 				break;
-			if (strstr(buffer, "#P:"))
-				assert(sscanf(buffer, "#%*[^#]#P:%u", &nrcpus) == 1);
-			fgets(buffer, BUFSIZE, f);
+			event = memmem(line, len, "#P:", 3);
+			if (event)
+				assert(!line_scan_int(event, len - (event - line),
+						      "#P:", &nrcpus));
+			line = trace_file_getline(tf, &len);
 		}
 	} else {
 		fprintf(stderr, "%s: unrecognized import format in '%s'\n",
 				__func__, options->filename);
+		trace_file_close(tf);
 		return NULL;
 	}
 
 	if (!nrcpus) {
-		fclose(f);
+		if (td)
+			trace_dat_close(td);
+		trace_file_close(tf);
 		return ptrerror("read error for 'cpus=' in trace file");
 	}
 
 	datas = malloc(sizeof(*datas));
 	if (!datas) {
-		fclose(f);
+		if (td)
+			trace_dat_close(td);
+		trace_file_close(tf);
 		return ptrerror("malloc datas");
 	}
 
-	datas->cstates = build_cstate_info(nrcpus);
+	datas->cstates = build_cstate_info(nrcpus, options->compact);
 	if (!datas->cstates) {
 		free(datas);
-		fclose(f);
+		if (td)
+			trace_dat_close(td);
+		trace_file_close(tf);
 		return ptrerror("build_cstate_info: out of memory");
 	}
 
@@ -992,54 +1092,198 @@ static struct cpuidle_datas *idlestat_load(struct program_options *options)
 	if (!datas->pstates) {
 		free(datas->cstates);
 		free(datas);
-		fclose(f);
+		if (td)
+			trace_dat_close(td);
+		trace_file_close(tf);
 		return ptrerror("build_pstate_info: out of memory");
 	}
 
 	datas->nrcpus = nrcpus;
+	datas->clusters = NULL;
+
+	/* read topology information, only the trace.dat files recorded by
+	 * idlestat carry it, use the one of this host for the others */
+	if (td) {
+		const char *topo = trace_dat_topology(td, &len);
+		struct trace_file *ttf = NULL;
+
+		if (topo)
+			ttf = trace_file_open_mem(topo, len);
+		if (ttf) {
+			line = trace_file_getline(ttf, &len);
+			read_cpu_topo_info(ttf, &line, &len);
+			trace_file_close(ttf);
+			line = NULL;
+		} else
+			read_sysfs_cpu_topo();
+	} else
+		read_cpu_topo_info(tf, &line, &len);
+
+	if (restrict_cpu_topo_info(nrcpus)) {
+		if (td)
+			trace_dat_close(td);
+		trace_file_close(tf);
+		release_pstate_info(datas->pstates, nrcpus);
+		release_cstate_info(datas->cstates, nrcpus);
+		free(datas);
+		return ptrerror("restrict_cpu_topo_info: out of memory");
+	}
 
-	/* read topology information */
-	read_cpu_topo_info(f, buffer);
+	/* the events of a sharded trace are in one file per CPU */
+	if (options->format == IDLESTAT_HEADER && line &&
+	    !line_scan_int(line, len, "shards=", &nrshards)) {
+		line = NULL;
+		if (windowed) {
+			fprintf(stderr, "warning: '%s' is sharded, importing "
+				"the whole trace\n", options->filename);
+			windowed = false;
+		}
+		if (options->memory_limit)
+			fprintf(stderr, "warning: '%s' is sharded, its events "
+				"are held in memory beyond the limit\n",
+				options->filename);
+	}
 
-	do {
-		if (strstr(buffer, "cpu_idle")) {
-			assert(sscanf(buffer, TRACE_FORMAT, &time, &state,
-				      &cpu) == 3);
+	/* the cores and the clusters can only be followed while importing
+	 * when the events are stored in time order */
+	if (options->online && !nrshards &&
+	    (td || windowed || options->jobs <= 1 || !tf->map))
+		datas->clusters = cpu_topo_cluster_tracker(nrcpus,
+							   options->at_least,
+							   options->level);
+	else if (options->online)
+		fprintf(stderr, "warning: '%s' is imported in parallel, the "
+			"clusters are computed after the import\n",
+			options->filename);
+
+	if (windowed && import_window_init(&window, options->from,
+					   options->to, nrcpus)) {
+		if (td)
+			trace_dat_close(td);
+		trace_file_close(tf);
+		cluster_tracker_release(datas->clusters);
+		release_pstate_info(datas->pstates, nrcpus);
+		release_cstate_info(datas->cstates, nrcpus);
+		free(datas);
+		return ptrerror("import_window_init: out of memory");
+	}
 
-			if (start) {
-				begin = time;
-				start = 0;
+	/* a partial last line is left for the next incremental import */
+	if (options->incremental && !td)
+		trace_file_complete(tf);
+
+	import_stats_init(&stats);
+resume:
+	if (nrshards) {
+		failed = import_shards(options->filename, nrshards, datas,
+				       options->jobs, &stats);
+	} else if (td) {
+		failed = trace_dat_import(td, datas, &stats,
+					  windowed ? &window : NULL);
+		trace_dat_close(td);
+	} else if (windowed) {
+		/* jump close to the window start with the index, the
+		 * trace is read from the beginning otherwise */
+		trace_file_rewind(tf, line);
+		index = trace_index_get(options->filename, tf, nrcpus,
+					options->nocache);
+		if (index) {
+			offset = trace_index_seek(index, options->from, &window);
+			if (offset) {
+				trace_file_seek(tf, offset);
+				line = trace_file_getline(tf, &len);
 			}
-			end = time;
-
-			store_data(time, state, cpu, datas, count);
-			count++;
+			trace_index_release(index);
+		}
+	} else if (options->jobs > 1 && tf->map) {
+		trace_file_rewind(tf, line);
+		failed = import_chunks(tf, datas, options->jobs, &stats);
+		line = NULL;
+	} else if (options->pipeline) {
+		trace_file_rewind(tf, line);
+		failed = import_pipeline(tf, datas, &stats, &stalls);
+		if (!failed && options->verbose)
+			fprintf(stderr, "Pipeline stalls: reader %lu, "
+				"parser %lu (input) %lu (output), "
+				"aggregator %lu\n", stalls.reader_full,
+				stalls.parser_empty, stalls.parser_full,
+				stalls.aggregator_empty);
+		line = NULL;
+	} else if (options->jobs > 1)
+		fprintf(stderr, "warning: '%s' can not be mapped, "
+			"importing with a single thread\n", options->filename);
+
+	for (; line; line = trace_file_getline(tf, &len)) {
+		if (parse_trace_line(line, len, &ev) || ev.cpu >= nrcpus)
 			continue;
-		} else if (strstr(buffer, "cpu_frequency")) {
-			assert(sscanf(buffer, TRACE_FORMAT, &time, &freq,
-				      &cpu) == 3);
-			assert(datas->pstates[cpu].pstate != NULL);
-			cpu_change_pstate(datas, cpu, freq, time);
-			count++;
+
+		if (windowed) {
+			ret = import_window_store(&window, datas, &ev, &stats);
+			if (ret < 0)
+				failed = -1;
+			if (ret)
+				break;
 			continue;
 		}
 
-		ret = get_wakeup_irq(datas, buffer, count);
-		count += (0 == ret) ? 1 : 0;
+		import_stats_account(&stats, &ev);
+		if (store_event(datas, &ev, stats.count - 1)) {
+			failed = -1;
+			break;
+		}
+	}
+
+	/* the import of a text trace can be resumed after its last line */
+	offset = 0;
+	if (!td && tf->map && tf->size && tf->map[tf->size - 1] == '\n')
+		offset = tf->size;
+
+	/* the cache is keyed on the trace as it was opened, not on the
+	 * lines appended since, and on the lines imported only when the
+	 * import can be resumed */
+	nokey = options->nocache ||
+		cache_key_stat(options->filename, &tf->stat,
+			       offset ? offset : tf->stat.st_size, &key) < 0;
+
+	/* the decompressor failed, the trace was read partially */
+	if (trace_file_close(tf))
+		failed = -1;
+
+	if (windowed) {
+		if (!failed && import_window_end(&window, datas))
+			failed = -1;
+		import_window_release(&window);
+	}
+
+	if (failed) {
+		fprintf(stderr, "%s: failed to import '%s'\n",
+			__func__, options->filename);
+		cluster_tracker_release(datas->clusters);
+		release_pstate_info(datas->pstates, nrcpus);
+		release_cstate_info(datas->cstates, nrcpus);
+		free(datas);
+		return NULL;
+	}
 
-	} while (fgets(buffer, BUFSIZE, f));
+	update_cstate_stats(datas);
 
-	fclose(f);
+	/* the cache holds the statistics of the whole trace only, and
+	 * its key does not cover the shards */
+	if (!options->nocache && !windowed && !nrshards &&
+	    (nokey ||
+	     cache_store(options->filename, &key, datas, &stats, offset)) &&
+	    options->verbose)
+		fprintf(stderr, "warning: failed to cache '%s'\n",
+			options->filename);
 
-	fprintf(stderr, "Log is %lf secs long with %zd events\n",
-		end - begin, count);
+	idlestat_log_stats(&stats);
 
 	return datas;
 }
 
 struct cpuidle_datas *cluster_data(struct cpuidle_datas *datas)
 {
-	struct cpuidle_cstate *c1, *cstates;
+	struct cpuidle_cstate **cs, *cstates;
 	struct cpuidle_datas *result;
 	int i, j;
 	int cstate_max = -1;
@@ -1050,9 +1294,13 @@ struct cpuidle_datas *cluster_data(struct cpuidle_datas *datas)
 
 	result->nrcpus = -1; /* the cluster */
 	result->pstates = NULL;
-	result->cstates = calloc(sizeof(*result->cstates), 1);
-	if (!result->cstates) {
+	result->clusters = NULL;
+	result->cstates = aligned_calloc(1, sizeof(*result->cstates));
+	cs = malloc(datas->nrcpus * sizeof(*cs));
+	if (!result->cstates || !cs) {
+		free(result->cstates);
 		free(result);
+		free(cs);
 		return NULL;
 	}
 
@@ -1063,14 +1311,12 @@ struct cpuidle_datas *cluster_data(struct cpuidle_datas *datas)
 
 	for (i = 0; i < cstate_max + 1; i++) {
 
-		for (j = 0, cstates = NULL; j < datas->nrcpus; j++) {
-
-			c1 = &datas->cstates[j].cstate[i];
+		for (j = 0; j < datas->nrcpus; j++)
+			cs[j] = &datas->cstates[j].cstate[i];
 
-			cstates = inter(cstates, c1);
-			if (!cstates)
-				continue;
-		}
+		cstates = inter(cs, datas->nrcpus, &result->cstates[0].arena);
+		if (!cstates)
+			continue;
 
 		/* copy state names from the first cpu */
 		cstates->name = strdup(datas->cstates[0].cstate[i].name);
@@ -1078,82 +1324,210 @@ struct cpuidle_datas *cluster_data(struct cpuidle_datas *datas)
 		result->cstates[0].cstate[i] = *cstates;
 	}
 
+	free(cs);
+
 	return result;
 }
 
-struct cpuidle_cstates *core_cluster_data(struct cpu_core *s_core)
+/*
+ * The C-states of a group of CPUs by depth: the state k of the group
+ * holds the time all the CPUs were in the state k or in a deeper one.
+ */
+static struct cpuidle_cstates *depth_data(struct cpuidle_cstates **cpus,
+					  int n)
 {
-	struct cpuidle_cstate *c1, *cstates;
 	struct cpuidle_cstates *result;
-	struct cpu_cpu      *s_cpu;
 	int i;
+
+	result = aligned_calloc(1, sizeof(*result));
+	if (!result)
+		return NULL;
+
+	if (cstates_depth_sweep(result, cpus, n)) {
+		free(result);
+		return NULL;
+	}
+
+	result->cstate_max = -1;
+	for (i = 0; i < n; i++)
+		result->cstate_max = MAX(result->cstate_max,
+					 cpus[i]->cstate_max);
+
+	/* copy state names from the first cpu */
+	for (i = 0; i < result->cstate_max + 1; i++) {
+		struct cpuidle_cstate *c = &result->cstate[i];
+
+		c->name = cluster_cstate_name(cpus[0]->cstate[i].name, 1);
+		c->avg_time = c->nrdata ? c->duration / c->nrdata : 0;
+	}
+
+	return result;
+}
+
+struct cpuidle_cstates *core_cluster_data(struct cpu_core *s_core,
+					  int at_least)
+{
+	struct cpuidle_cstate **cs, *cstates;
+	struct cpuidle_cstates *result, **cpus;
+	struct cpu_cpu      *s_cpu;
+	int i, n;
 	int cstate_max = -1;
 
 	if (!s_core->is_ht)
-		list_for_each_entry(s_cpu, &s_core->cpu_head, list_cpu)
-			return s_cpu->cstates;
+		return s_core->cpus[0].cstates;
 
-	result = calloc(sizeof(*result), 1);
-	if (!result)
+	if (at_least) {
+		cpus = malloc(s_core->cpu_num * sizeof(*cpus));
+		if (!cpus)
+			return NULL;
+
+		n = 0;
+		core_for_each_cpu(s_core, s_cpu)
+			cpus[n++] = s_cpu->cstates;
+
+		result = depth_data(cpus, n);
+		free(cpus);
+
+		return result;
+	}
+
+	result = aligned_calloc(1, sizeof(*result));
+	cs = malloc(s_core->cpu_num * sizeof(*cs));
+	if (!result || !cs) {
+		free(result);
+		free(cs);
 		return NULL;
+	}
 
 	/* hack but negligeable overhead */
-	list_for_each_entry(s_cpu, &s_core->cpu_head, list_cpu)
+	core_for_each_cpu(s_core, s_cpu)
 		cstate_max = MAX(cstate_max, s_cpu->cstates->cstate_max);
 	result->cstate_max = cstate_max;
 
 	for (i = 0; i < cstate_max + 1; i++) {
-		cstates = NULL;
-		list_for_each_entry(s_cpu, &s_core->cpu_head, list_cpu) {
-			c1 = &s_cpu->cstates->cstate[i];
+		n = 0;
+		core_for_each_cpu(s_core, s_cpu)
+			cs[n++] = &s_cpu->cstates->cstate[i];
+
+		cstates = inter(cs, n, &result->arena);
+		if (!cstates)
+			continue;
 
-			cstates = inter(cstates, c1);
-			if (!cstates)
-				continue;
-		}
 		/* copy state name from first cpu */
-		s_cpu = list_first_entry(&s_core->cpu_head, struct cpu_cpu,
-				list_cpu);
+		s_cpu = &s_core->cpus[0];
 		cstates->name = strdup(s_cpu->cstates->cstate[i].name);
 
 		result->cstate[i] = *cstates;
 	}
 
+	free(cs);
+
 	return result;
 }
 
-struct cpuidle_cstates *physical_cluster_data(struct cpu_physical *s_phy)
+/**
+ * group_cluster_alloc - allocate the C-states of a group before
+ * intersecting them one by one with group_cluster_state()
+ * @g: the group
+ *
+ * Return: the C-states of the group, NULL if out of memory
+ */
+struct cpuidle_cstates *group_cluster_alloc(struct cpu_group *g)
 {
-	struct cpuidle_cstate *c1, *cstates;
 	struct cpuidle_cstates *result;
 	struct cpu_core      *s_core;
-	int i;
 	int cstate_max = -1;
 
-	result = calloc(sizeof(*result), 1);
+	result = aligned_calloc(1, sizeof(*result));
 	if (!result)
 		return NULL;
 
 	/* hack but negligeable overhead */
-	list_for_each_entry(s_core, &s_phy->core_head, list_core)
+	group_for_each_core(g, s_core)
 		cstate_max = MAX(cstate_max, s_core->cstates->cstate_max);
 	result->cstate_max = cstate_max;
 
-	for (i = 0; i < cstate_max + 1; i++) {
-		cstates = NULL;
-		list_for_each_entry(s_core, &s_phy->core_head, list_core) {
-			c1 = &s_core->cstates->cstate[i];
+	return result;
+}
 
-			cstates = inter(cstates, c1);
-			if (!cstates)
-				continue;
-		}
-		/* copy state name from first core */
-		s_core = list_first_entry(&s_phy->core_head, struct cpu_core,
-				list_core);
-		cstates->name = strdup(s_core->cstates->cstate[i].name);
+/**
+ * group_cluster_state - intersect a C-state of the cores of a group
+ * @g: the group
+ * @result: the C-states of the group, from group_cluster_alloc()
+ * @state: the C-state
+ * @arena: holds the intersection, the states of a group can be
+ * intersected concurrently in different arenas
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int group_cluster_state(struct cpu_group *g, struct cpuidle_cstates *result,
+			int state, struct arena *arena)
+{
+	struct cpuidle_cstate **cs, *cstates;
+	struct cpu_core      *s_core;
+	int n = 0;
 
-		result->cstate[i] = *cstates;
+	cs = malloc(g->core_num * sizeof(*cs));
+	if (!cs)
+		return -1;
+
+	group_for_each_core(g, s_core)
+		cs[n++] = &s_core->cstates->cstate[state];
+
+	cstates = inter(cs, n, arena);
+	free(cs);
+	if (!cstates)
+		return 0;
+
+	/* copy state name from first core */
+	s_core = &g->cores[0];
+	cstates->name = strdup(s_core->cstates->cstate[state].name);
+
+	result->cstate[state] = *cstates;
+
+	return 0;
+}
+
+/**
+ * group_cluster_data - intersect the C-states of the cores of a group
+ * @g: the group
+ * @at_least: a group is in a C-state while its CPUs are in it or deeper
+ *
+ * Return: the C-states of the group, NULL if out of memory
+ */
+struct cpuidle_cstates *group_cluster_data(struct cpu_group *g, int at_least)
+{
+	struct cpuidle_cstates *result, **cpus;
+	struct cpu_cpu       *s_cpu;
+	int i, n;
+
+	/* the cores hold the statistics only, the sweep goes over all the
+	 * CPUs of the cluster */
+	if (at_least) {
+		cpus = malloc(g->cpu_num * sizeof(*cpus));
+		if (!cpus)
+			return NULL;
+
+		n = 0;
+		group_for_each_cpu(g, s_cpu)
+			cpus[n++] = s_cpu->cstates;
+
+		result = depth_data(cpus, n);
+		free(cpus);
+
+		return result;
+	}
+
+	result = group_cluster_alloc(g);
+	if (!result)
+		return NULL;
+
+	for (i = 0; i < result->cstate_max + 1; i++) {
+		if (group_cluster_state(g, result, i, &result->arena)) {
+			arena_release(&result->arena);
+			free(result);
+			return NULL;
+		}
 	}
 
 	return result;
@@ -1164,10 +1538,17 @@ static void help(const char *cmd)
 	fprintf(stderr,
 		"\nUsage:\nTrace mode:\n\t%s --trace -f|--trace-file <filename>"
 		" -o|--output-file <filename> -t|--duration <seconds>"
-		" -c|--idle -p|--frequency -w|--wakeup", basename(cmd));
+		" -c|--idle -p|--frequency -w|--wakeup -C|--concurrency"
+		" --binary --shards",
+		basename(cmd));
 	fprintf(stderr,
 		"\nReporting mode:\n\t%s --import -f|--trace-file <filename>"
-		" -o|--output-file <filename>", basename(cmd));
+		" -o|--output-file <filename> -j|--jobs <threads>"
+		" --pipeline --no-cache --incremental --from <seconds>"
+		" --to <seconds> --compact --online --at-least"
+		" --level <cluster|llc|node|die|package>"
+		" --memory-limit <size>",
+		basename(cmd));
 	fprintf(stderr,
 		"\n\nExamples:\n1. Run a trace, post-process the results"
 		" (default is to show only C-state statistics):\n\tsudo "
@@ -1189,6 +1570,59 @@ static void help(const char *cmd)
 		" -o /tmp/myreport\n", basename(cmd));
 }
 
+/* a trace timestamp in seconds, as printed in the trace */
+static int parse_seconds(const char *arg, uint64_t *time)
+{
+	char *end;
+	double sec;
+
+	sec = strtod(arg, &end);
+	if (end == arg || *end || sec < 0) {
+		fprintf(stderr, "invalid time '%s', expected seconds\n", arg);
+		return -1;
+	}
+
+	*time = sec * NSEC_PER_SEC + .5;
+
+	return 0;
+}
+
+/* a size in bytes, with an optional K, M or G suffix */
+static int parse_size(const char *arg, uint64_t *size)
+{
+	unsigned long long value;
+	char *end;
+	int shift = 0;
+
+	errno = 0;
+	value = strtoull(arg, &end, 10);
+	if (end == arg || errno)
+		goto invalid;
+
+	switch (*end) {
+	case 'G': case 'g':
+		shift += 10;
+		/* fall through */
+	case 'M': case 'm':
+		shift += 10;
+		/* fall through */
+	case 'K': case 'k':
+		shift += 10;
+		end++;
+	}
+
+	if (*end || !value || value > UINT64_MAX >> shift)
+		goto invalid;
+
+	*size = (uint64_t)value << shift;
+
+	return 0;
+invalid:
+	fprintf(stderr, "invalid size '%s', expected bytes or K, M, G\n",
+		arg);
+	return -1;
+}
+
 static void version(const char *cmd)
 {
 	printf("%s version %s\n", basename(cmd), IDLESTAT_VERSION);
@@ -1199,6 +1633,18 @@ int getoptions(int argc, char *argv[], struct program_options *options)
 	struct option long_options[] = {
 		{ "trace",       no_argument,       &options->mode, TRACE },
 		{ "import",      no_argument,       &options->mode, IMPORT },
+		{ "pipeline",    no_argument,       &options->pipeline, 1 },
+		{ "binary",      no_argument,       &options->binary, 1 },
+		{ "no-cache",    no_argument,       &options->nocache, 1 },
+		{ "incremental", no_argument,       &options->incremental, 1 },
+		{ "shards",      no_argument,       &options->shards, 1 },
+		{ "compact",     no_argument,       &options->compact, 1 },
+		{ "online",      no_argument,       &options->online, 1 },
+		{ "at-least",    no_argument,       &options->at_least, 1 },
+		{ "from",        required_argument, NULL, 'F' },
+		{ "to",          required_argument, NULL, 'T' },
+		{ "level",       required_argument, NULL, 'L' },
+		{ "memory-limit", required_argument, NULL, 'M' },
 		{ "trace-file",  required_argument, NULL, 'f' },
 		{ "output-file", required_argument, NULL, 'o' },
 		{ "help",        no_argument,       NULL, 'h' },
@@ -1208,6 +1654,8 @@ int getoptions(int argc, char *argv[], struct program_options *options)
 		{ "idle",        no_argument,       NULL, 'c' },
 		{ "frequency",   no_argument,       NULL, 'p' },
 		{ "wakeup",      no_argument,       NULL, 'w' },
+		{ "concurrency", no_argument,       NULL, 'C' },
+		{ "jobs",        required_argument, NULL, 'j' },
 		{ 0, 0, 0, 0 }
 	};
 	int c;
@@ -1217,11 +1665,14 @@ int getoptions(int argc, char *argv[], struct program_options *options)
 	options->outfilename = NULL;
 	options->mode = -1;
 	options->format = -1;
+	options->jobs = 1;
+	options->to = UINT64_MAX;
+	options->level = TOPO_PACKAGE;
 	while (1) {
 
 		int optindex = 0;
 
-		c = getopt_long(argc, argv, ":df:o:ht:cpwVv",
+		c = getopt_long(argc, argv, ":df:o:ht:cpwCVvj:",
 				long_options, &optindex);
 		if (c == -1)
 			break;
@@ -1249,6 +1700,32 @@ int getoptions(int argc, char *argv[], struct program_options *options)
 		case 'w':
 			options->display |= WAKEUP_DISPLAY;
 			break;
+		case 'C':
+			options->display |= CONCURRENCY_DISPLAY;
+			break;
+		case 'j':
+			options->jobs = atoi(optarg);
+			break;
+		case 'F':
+			if (parse_seconds(optarg, &options->from))
+				return -1;
+			break;
+		case 'T':
+			if (parse_seconds(optarg, &options->to))
+				return -1;
+			break;
+		case 'L':
+			options->level = topo_level_parse(optarg);
+			if (options->level < 0) {
+				fprintf(stderr, "unknown topology level '%s'\n",
+					optarg);
+				return -1;
+			}
+			break;
+		case 'M':
+			if (parse_size(optarg, &options->memory_limit))
+				return -1;
+			break;
 		case 'V':
 			version(argv[0]);
 			exit(0);
@@ -1292,6 +1769,23 @@ int getoptions(int argc, char *argv[], struct program_options *options)
 		}
 	}
 
+	if (options->jobs <= 0) {
+		fprintf(stderr, "expected -j <jobs> greater than 0\n");
+		return -1;
+	}
+
+	/* the parallel imports hold the events in memory */
+	if (options->memory_limit && options->jobs > 1) {
+		fprintf(stderr, "warning: --memory-limit imports with a "
+			"single thread\n");
+		options->jobs = 1;
+	}
+
+	if (options->from > options->to) {
+		fprintf(stderr, "expected --from <seconds> before --to\n");
+		return -1;
+	}
+
 	if (options->display == 0)
 		options->display = IDLE_DISPLAY;
 
@@ -1299,43 +1793,44 @@ int getoptions(int argc, char *argv[], struct program_options *options)
 }
 
 static int idlestat_file_for_each_line(const char *path, void *data,
-					int (*handler)(const char *, void *))
+				int (*handler)(const char *, size_t, void *))
 {
-	FILE *f;
-	int ret;
+	struct trace_file *tf;
+	char *line;
+	size_t len;
+	int ret = 0;
 
 	if (!handler)
 		return -1;
 
-	f = fopen(path, "r");
-
-	if (!f) {
-		fprintf(stderr, "%s: failed to open '%s': %m\n",
-			__func__, path);
+	tf = trace_file_open(path);
+	if (!tf)
 		return -1;
-	}
 
-	while (fgets(buffer, BUFSIZE, f)) {
-		ret = handler(buffer, data);
+	while ((line = trace_file_getline(tf, &len))) {
+		ret = handler(line, len, data);
 		if (ret)
 			break;
 	}
 
-	fclose(f);
+	if (trace_file_close(tf) && !ret)
+		ret = -1;
 
 	return ret;
 }
 
-static int idlestat_store(const char *path)
+static int idlestat_store(const char *path, int shards)
 {
-	FILE *f;
-	int ret;
+	const struct compressor *c;
+	FILE *f, *file;
+	pid_t pid;
+	int ret, fd;
 
 	ret = sysconf(_SC_NPROCESSORS_CONF);
 	if (ret < 0)
 		return -1;
 
-	f = fopen(path, "w+");
+	file = f = fopen(path, "w+");
 
 	if (!f) {
 		fprintf(stderr, "%s: failed to open '%s': %m\n",
@@ -1343,15 +1838,41 @@ static int idlestat_store(const char *path)
 		return -1;
 	}
 
+	/* the trace is compressed on the fly when the name asks for it */
+	c = compressor_for_path(path);
+	if (c) {
+		fd = compressor_spawn(c, 0, fileno(file), &pid);
+		f = fd < 0 ? NULL : fdopen(fd, "w");
+		if (!f) {
+			if (fd >= 0) {
+				close(fd);
+				compressor_wait(c, pid);
+			}
+			fclose(file);
+			return -1;
+		}
+	}
+
 	fprintf(f, "idlestat version = %s\n", IDLESTAT_VERSION);
 	fprintf(f, "cpus=%d\n", ret);
 
 	/* output topology information */
 	output_cpu_topo_info(f);
 
-	ret = idlestat_file_for_each_line(TRACE_FILE, f, store_line);
+	/* the events are stored next to the trace, one file per CPU */
+	if (shards) {
+		fprintf(f, "shards=%d\n", ret);
+		ret = shard_store(path, ret);
+	} else
+		ret = idlestat_file_for_each_line(TRACE_FILE, f, store_line);
 
-	fclose(f);
+	if (c) {
+		fclose(f);
+		if (compressor_wait(c, pid))
+			ret = -1;
+	}
+
+	fclose(file);
 
 	return ret;
 }
@@ -1498,6 +2019,9 @@ int main(int argc, char *argv[], char *const envp[])
 		return -1;
 	}
 
+	if (options.memory_limit && spill_init(options.memory_limit))
+		return 1;
+
 	/* init cpu topoinfo */
 	init_cpu_topo_info();
 
@@ -1552,7 +2076,10 @@ int main(int argc, char *argv[], char *const envp[])
 		 * up all cpus and timer expiration for the timer
 		 * acquisition). We assume these will be lost in the number
 		 * of other traces and could be negligible. */
-		if (idlestat_store(options.filename))
+		if (options.binary) {
+			if (trace_dat_record(options.filename))
+				return -1;
+		} else if (idlestat_store(options.filename, options.shards))
 			return -1;
 	}
 
@@ -1565,7 +2092,11 @@ int main(int argc, char *argv[], char *const envp[])
 	/* Compute cluster idle intersection between cpus belonging to
 	 * the same cluster
 	 */
-	if (0 == establish_idledata_to_topo(datas)) {
+	if (0 == establish_idledata_to_topo(datas, options.at_least,
+					    options.level)) {
+		if (options.verbose)
+			idlestat_arena_stats(datas);
+
 		if (open_report_file(options.outfilename))
 			return -1;
 
@@ -1586,12 +2117,22 @@ int main(int argc, char *argv[], char *const envp[])
 			dump_cpu_topo_info(display_wakeup, 1);
 			display_wakeup_footer();
 		}
+
+		if (options.display & CONCURRENCY_DISPLAY) {
+			display_concurrency_header();
+			if (dump_cpu_topo_concurrency(datas,
+						      display_concurrency))
+				fprintf(stderr, "%s: out of memory\n",
+					__func__);
+			display_concurrency_footer();
+		}
 	}
 
 	release_cpu_topo_cstates();
 	release_cpu_topo_info();
 	release_pstate_info(datas->pstates, datas->nrcpus);
 	release_cstate_info(datas->cstates, datas->nrcpus);
+	cluster_tracker_release(datas->clusters);
 	free(datas);
 
 	return 0;
@@ -27,13 +27,19 @@
 #ifndef __IDLESTAT_H
 #define __IDLESTAT_H
 
-#define BUFSIZE 256
+#include <stdint.h>
+
+#include "arena.h"
+
 #define NAMELEN 16
 #define MAXCSTATE 16
 #define MAXPSTATE 16
 #define MAX(A, B) (A > B ? A : B)
 #define MIN(A, B) (A < B ? A : B)
-#define AVG(A, B, I) ((A) + ((B - A) / (I)))
+
+/* per-CPU structures updated by different threads get their own lines */
+#define CACHELINE_SIZE 64
+#define __cacheline_aligned __attribute__((aligned(CACHELINE_SIZE)))
 
 #define IRQ_WAKEUP_UNIT_NAME "cpu"
 
@@ -44,23 +50,59 @@
 #define CPUIDLE_STATENAME_PATH_FORMAT \
 	"/sys/devices/system/cpu/cpu%d/cpuidle/state%d/name"
 
+/* the times are in nanoseconds */
 struct cpuidle_data {
-	double begin;
-	double end;
-	double duration;
+	uint64_t begin;
+	uint64_t end;
+};
+
+/*
+ * The intervals of a C-state are stored in chunks allocated from the
+ * arena of the CPU, or of the cluster, so storing one never moves the
+ * others. The table of the chunks doubles when their count reaches a
+ * power of two. A chunk keeps the beginnings and the ends in separate
+ * columns, the statistics are computed over them with vector kernels.
+ */
+#define CPUIDLE_DATA_CHUNK_SHIFT 10
+#define CPUIDLE_DATA_CHUNK (1 << CPUIDLE_DATA_CHUNK_SHIFT)
+
+struct cpuidle_chunk {
+	uint64_t begin[CPUIDLE_DATA_CHUNK];
+	uint64_t end[CPUIDLE_DATA_CHUNK];
+};
+
+/*
+ * In compact mode, the intervals are packed in a list of blocks instead,
+ * each one as the varints of the time since the end of the previous
+ * interval and of its duration. See interval.c.
+ */
+#define CPUIDLE_PACK_SIZE 224
+
+struct cpuidle_pack {
+	struct cpuidle_pack *next;
+	uint64_t base;		/* end of the interval before the block */
+	uint64_t end;		/* end of the last interval of the block */
+	int count;		/* intervals in the block */
+	int len;		/* bytes used */
+	unsigned char data[CPUIDLE_PACK_SIZE];
 };
 
 struct cpuidle_cstate {
 	char *name;
-	struct cpuidle_data *data;
+	struct cpuidle_chunk **data;	/* the chunks */
+	int nrchunks;
+	int compact;
+	struct cpuidle_pack *packs;	/* compact mode */
+	struct cpuidle_pack *last_pack;
+	uint64_t open;			/* compact mode: idle entry time */
 	int nrdata;
 	int premature_wakeup;
 	int could_sleep_more;
-	double avg_time;
-	double max_time;
-	double min_time;
-	double duration;
-	int target_residency; /* -1 if not available */
+	uint64_t avg_time;
+	uint64_t max_time;
+	uint64_t min_time;
+	uint64_t duration;
+	int target_residency; /* us, -1 if not available */
 };
 
 enum IRQ_TYPE {
@@ -84,35 +126,37 @@ struct wakeup_info {
 
 struct cpuidle_cstates {
 	struct cpuidle_cstate cstate[MAXCSTATE];
+	struct arena arena;		/* the intervals of the C-states */
 	struct wakeup_info wakeinfo;
 	int last_cstate;
 	int cstate_max;
 	struct wakeup_irq *wakeirq;
 	int not_predicted;
-};
+} __cacheline_aligned;
 
 struct cpufreq_pstate {
 	int id;
 	unsigned int freq;
 	int count;
-	double min_time;
-	double max_time;
-	double avg_time;
-	double duration;
+	uint64_t min_time;
+	uint64_t max_time;
+	uint64_t avg_time;
+	uint64_t duration;
 };
 
 struct cpufreq_pstates {
 	struct cpufreq_pstate *pstate;
 	int current;
 	int idle;
-	double time_enter;
-	double time_exit;
+	uint64_t time_enter;
+	uint64_t time_exit;
 	int max;
-};
+} __cacheline_aligned;
 
 struct cpuidle_datas {
 	struct cpuidle_cstates *cstates;
 	struct cpufreq_pstates *pstates;
+	struct cluster_tracker *clusters;	/* NULL if not followed */
 	int nrcpus;
 };
 
@@ -123,7 +167,8 @@ enum modes {
 
 enum formats {
 	IDLESTAT_HEADER = 0,
-	TRACE_CMD_HEADER
+	TRACE_CMD_HEADER,
+	TRACE_CMD_DAT
 };
 
 struct program_options {
@@ -134,10 +179,29 @@ struct program_options {
 	char *filename;
 	char *outfilename;
 	int verbose;
+	int jobs;
+	int pipeline;
+	int binary;
+	int nocache;
+	int incremental;
+	int shards;
+	int compact;
+	int online;
+	int at_least;		/* report the clusters by depth */
+	int level;		/* of the topology, reported as the clusters */
+	uint64_t from;		/* window to import, in nanoseconds */
+	uint64_t to;
+	uint64_t memory_limit;	/* bytes, 0 without a limit */
 };
 
 #define IDLE_DISPLAY      0x1
 #define FREQUENCY_DISPLAY 0x2
 #define WAKEUP_DISPLAY    0x4
+#define CONCURRENCY_DISPLAY 0x8
+
+struct trace_event;
+
+extern int store_event(struct cpuidle_datas *datas, struct trace_event *ev,
+		       int count);
 
 #endif
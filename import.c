@@ -0,0 +1,359 @@
+/*
+ *  import.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "import.h"
+#include "pool.h"
+#include "utils.h"
+#include "scan.h"
+
+/*
+ * The C-state, P-state and wakeup statistics of a CPU only depend on the
+ * events of this CPU, in the order they appear in the trace. The
+ * chunked import splits the trace at line boundaries, parses the chunks
+ * in parallel into per-CPU event buffers and then replays the events
+ * of each CPU, chunk after chunk, in parallel again.
+ */
+struct import_chunk {
+	const char *start;
+	const char *end;
+	int nrcpus;
+	struct event_buffer *cpus;
+	struct import_stats stats;
+	int error;
+} __cacheline_aligned;
+
+struct replay_task {
+	struct cpuidle_datas *datas;
+	struct import_chunk *chunks;
+	int nrchunks;
+	int cpu;
+	int error;
+} __cacheline_aligned;
+
+int event_buffer_add(struct event_buffer *buf, struct trace_event *ev)
+{
+	if (buf->nrevents == buf->size) {
+		size_t size = buf->size ? buf->size * 2 : 1024;
+		struct trace_event *tmp;
+
+		tmp = realloc(buf->events, size * sizeof(*tmp));
+		if (!tmp)
+			return -1;
+
+		buf->events = tmp;
+		buf->size = size;
+	}
+
+	buf->events[buf->nrevents++] = *ev;
+
+	return 0;
+}
+
+static void parse_chunk(void *arg)
+{
+	struct import_chunk *chunk = arg;
+	const char *line = chunk->start, *eols[SCAN_LINES_BATCH];
+	struct trace_event ev;
+	size_t i, n;
+
+	while (line < chunk->end) {
+		n = scan_lines(line, chunk->end, eols, SCAN_LINES_BATCH);
+		if (!n)
+			eols[n++] = chunk->end;
+
+		for (i = 0; i < n; line = eols[i++] + 1) {
+			if (parse_trace_line(line, eols[i] - line, &ev) ||
+			    ev.cpu >= chunk->nrcpus)
+				continue;
+
+			if (event_buffer_add(&chunk->cpus[ev.cpu], &ev)) {
+				chunk->error = -1;
+				return;
+			}
+			import_stats_account(&chunk->stats, &ev);
+		}
+	}
+}
+
+static void replay_cpu(void *arg)
+{
+	struct replay_task *task = arg;
+	struct event_buffer *buf;
+	size_t count = 0;
+	int i, j;
+
+	for (i = 0; i < task->nrchunks; i++) {
+		buf = &task->chunks[i].cpus[task->cpu];
+		for (j = 0; j < buf->nrevents && !task->error; j++)
+			if (store_event(task->datas, &buf->events[j], count++))
+				task->error = -1;
+
+		free(buf->events);
+		buf->events = NULL;
+	}
+}
+
+/**
+ * import_chunks - load the events of a mapped trace with several threads
+ * @tf: the trace file, positioned at the first event line
+ * @datas: the per-CPU statistics to fill
+ * @jobs: number of threads
+ * @stats: filled with the log duration and the number of events
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int import_chunks(struct trace_file *tf, struct cpuidle_datas *datas,
+		  int jobs, struct import_stats *stats)
+{
+	struct thread_pool *pool;
+	struct import_chunk *chunks;
+	struct replay_task *tasks;
+	const char *start, *end;
+	size_t chunk_size;
+	int i, ret = -1;
+
+	start = tf->map + MIN(tf->pos, tf->size);
+	end = tf->map + tf->size;
+	chunk_size = (end - start) / jobs + 1;
+
+	chunks = aligned_calloc(jobs, sizeof(*chunks));
+	tasks = aligned_calloc(datas->nrcpus, sizeof(*tasks));
+	pool = pool_create(jobs);
+	if (!chunks || !tasks || !pool)
+		goto out;
+
+	for (i = 0; i < jobs; i++) {
+		const char *eol;
+
+		chunks[i].start = start;
+		chunks[i].end = end;
+		chunks[i].nrcpus = datas->nrcpus;
+		import_stats_init(&chunks[i].stats);
+
+		/* cut the chunk after the end of a line */
+		if ((size_t)(end - start) > chunk_size) {
+			eol = scan_char(start + chunk_size, end, '\n');
+			if (eol)
+				chunks[i].end = eol + 1;
+		}
+		start = chunks[i].end;
+
+		chunks[i].cpus = calloc(datas->nrcpus,
+					sizeof(*chunks[i].cpus));
+		if (!chunks[i].cpus)
+			goto out;
+
+		if (pool_submit(pool, parse_chunk, &chunks[i]))
+			goto out;
+	}
+
+	pool_wait(pool);
+
+	for (i = 0; i < jobs; i++) {
+		if (chunks[i].error)
+			goto out;
+
+		stats->begin = MIN(stats->begin, chunks[i].stats.begin);
+		stats->end = MAX(stats->end, chunks[i].stats.end);
+		stats->count += chunks[i].stats.count;
+	}
+
+	for (i = 0; i < datas->nrcpus; i++) {
+		tasks[i].datas = datas;
+		tasks[i].chunks = chunks;
+		tasks[i].nrchunks = jobs;
+		tasks[i].cpu = i;
+
+		if (pool_submit(pool, replay_cpu, &tasks[i]))
+			goto out;
+	}
+
+	pool_wait(pool);
+
+	for (i = 0; i < datas->nrcpus; i++)
+		if (tasks[i].error)
+			goto out;
+
+	ret = 0;
+out:
+	if (pool) {
+		pool_wait(pool);
+		pool_destroy(pool);
+	}
+
+	for (i = 0; chunks && i < jobs; i++) {
+		int cpu;
+
+		for (cpu = 0; chunks[i].cpus && cpu < datas->nrcpus; cpu++)
+			free(chunks[i].cpus[cpu].events);
+		free(chunks[i].cpus);
+	}
+
+	free(chunks);
+	free(tasks);
+
+	tf->pos = tf->size;
+
+	return ret;
+}
+
+/**
+ * import_window_init - prepare the import of a time window
+ * @window: the window
+ * @from: the beginning of the window, in nanoseconds
+ * @to: the end of the window, in nanoseconds
+ * @nrcpus: the number of CPUs
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int import_window_init(struct import_window *window, uint64_t from,
+		       uint64_t to, int nrcpus)
+{
+	int cpu;
+
+	memset(window, 0, sizeof(*window));
+	window->from = from;
+	window->to = to;
+	window->nrcpus = nrcpus;
+	window->cstate = malloc(nrcpus * sizeof(*window->cstate));
+	window->freq = calloc(nrcpus, sizeof(*window->freq));
+	if (!window->cstate || !window->freq) {
+		import_window_release(window);
+		return -1;
+	}
+
+	for (cpu = 0; cpu < nrcpus; cpu++)
+		window->cstate[cpu] = -1;
+
+	return 0;
+}
+
+void import_window_release(struct import_window *window)
+{
+	free(window->cstate);
+	free(window->freq);
+	window->cstate = NULL;
+	window->freq = NULL;
+}
+
+/* open the C-states and the P-states of the CPUs at the window start */
+static int import_window_start(struct import_window *window,
+			       struct cpuidle_datas *datas)
+{
+	struct trace_event ev = { .time = window->from };
+	int cpu;
+
+	window->started = 1;
+
+	for (cpu = 0; cpu < window->nrcpus; cpu++) {
+		ev.cpu = cpu;
+
+		/* idle first, the P-state is then only recorded and is
+		 * opened when the CPU wakes up */
+		if (window->cstate[cpu] != -1) {
+			ev.type = EVENT_CPU_IDLE;
+			ev.value = window->cstate[cpu];
+			if (store_event(datas, &ev, 0))
+				return -1;
+		}
+
+		if (window->freq[cpu] && datas->pstates[cpu].pstate) {
+			ev.type = EVENT_CPU_FREQUENCY;
+			ev.value = window->freq[cpu];
+			if (store_event(datas, &ev, 0))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * import_window_store - store an event if it is in the window
+ * @window: the window
+ * @datas: the per-CPU statistics to fill
+ * @ev: the event, the events must be given in the trace order
+ * @stats: the import statistics, only the stored events are accounted
+ *
+ * Return: 1 once the event is past the end of the window, -1 if the
+ * event can not be stored, 0 otherwise
+ */
+int import_window_store(struct import_window *window,
+			struct cpuidle_datas *datas, struct trace_event *ev,
+			struct import_stats *stats)
+{
+	if (ev->time < window->from) {
+		import_window_track(window, ev);
+		return 0;
+	}
+
+	if (ev->time > window->to) {
+		window->done = 1;
+		return 1;
+	}
+
+	if (!window->started && import_window_start(window, datas))
+		return -1;
+
+	import_stats_account(stats, ev);
+
+	return store_event(datas, ev, stats->count - 1) ? -1 : 0;
+}
+
+/**
+ * import_window_end - close the window once the events are stored
+ * @window: the window
+ * @datas: the per-CPU statistics to fill
+ *
+ * The idle periods still open are closed at the end of the window, when
+ * the trace goes beyond it. Otherwise they are left open, as for the
+ * import of a whole trace.
+ *
+ * Return: 0 on success, -1 if an event can not be stored
+ */
+int import_window_end(struct import_window *window,
+		      struct cpuidle_datas *datas)
+{
+	struct trace_event ev = {
+		.time = window->to,
+		.type = EVENT_CPU_IDLE,
+		.value = -1,
+	};
+	int cpu;
+
+	if (!window->done)
+		return 0;
+
+	if (!window->started && import_window_start(window, datas))
+		return -1;
+
+	for (cpu = 0; cpu < window->nrcpus; cpu++) {
+		ev.cpu = cpu;
+		if (store_event(datas, &ev, 0))
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ *  import.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __IMPORT_H
+#define __IMPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "idlestat.h"
+#include "parser.h"
+#include "tracefile.h"
+
+struct import_stats {
+	uint64_t begin;		/* first cpu_idle event */
+	uint64_t end;		/* last cpu_idle event */
+	size_t count;		/* number of events */
+};
+
+static inline void import_stats_init(struct import_stats *stats)
+{
+	stats->begin = UINT64_MAX;
+	stats->end = 0;
+	stats->count = 0;
+}
+
+static inline void import_stats_account(struct import_stats *stats,
+					struct trace_event *ev)
+{
+	if (ev->type == EVENT_CPU_IDLE) {
+		stats->begin = MIN(stats->begin, ev->time);
+		stats->end = MAX(stats->end, ev->time);
+	}
+	stats->count++;
+}
+
+/*
+ * A time window of the trace to import. The events before the window
+ * are only used to follow the C-state and the P-state of each CPU, the
+ * state of the CPUs is then seeded at the beginning of the window, and
+ * the idle periods still open are closed at its end.
+ */
+struct import_window {
+	uint64_t from;		/* nanoseconds */
+	uint64_t to;
+	int nrcpus;
+	int *cstate;		/* -1 when running or unknown */
+	unsigned int *freq;	/* 0 when unknown */
+	int started;
+	int done;
+};
+
+extern int import_window_init(struct import_window *window, uint64_t from,
+			      uint64_t to, int nrcpus);
+extern void import_window_release(struct import_window *window);
+extern int import_window_store(struct import_window *window,
+			       struct cpuidle_datas *datas,
+			       struct trace_event *ev,
+			       struct import_stats *stats);
+extern int import_window_end(struct import_window *window,
+			     struct cpuidle_datas *datas);
+
+static inline void import_window_track(struct import_window *window,
+				       struct trace_event *ev)
+{
+	if (ev->type == EVENT_CPU_IDLE &&
+	    ((int)ev->value == -1 || ev->value < MAXCSTATE))
+		window->cstate[ev->cpu] = ev->value;
+	else if (ev->type == EVENT_CPU_FREQUENCY)
+		window->freq[ev->cpu] = ev->value;
+}
+
+/* a growable array of events */
+struct event_buffer {
+	struct trace_event *events;
+	size_t nrevents;
+	size_t size;
+};
+
+extern int event_buffer_add(struct event_buffer *buf, struct trace_event *ev);
+
+extern int import_chunks(struct trace_file *tf, struct cpuidle_datas *datas,
+			 int jobs, struct import_stats *stats);
+
+#endif
@@ -0,0 +1,347 @@
+/*
+ *  index.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "index.h"
+#include "parser.h"
+#include "scan.h"
+#include "spill.h"
+
+#define INDEX_MAGIC "idlestat-index"
+#define INDEX_VERSION 1
+
+struct index_header {
+	char magic[16];
+	uint32_t version;
+	int32_t nrcpus;
+	struct cache_key key;
+	uint64_t nrentries;
+};
+
+void trace_index_release(struct trace_index *index)
+{
+	if (!index)
+		return;
+
+	free(index->entries);
+	free(index->cstates);
+	free(index->freqs);
+	free(index);
+}
+
+static struct trace_index *trace_index_alloc(int nrcpus, size_t nrentries)
+{
+	struct trace_index *index;
+
+	index = calloc(1, sizeof(*index));
+	if (!index)
+		return NULL;
+
+	index->nrcpus = nrcpus;
+	index->nrentries = nrentries;
+	index->entries = malloc(MAX(nrentries, 1) * sizeof(*index->entries));
+	index->cstates = malloc(MAX(nrentries, 1) * nrcpus *
+				sizeof(*index->cstates));
+	index->freqs = malloc(MAX(nrentries, 1) * nrcpus *
+			      sizeof(*index->freqs));
+	if (!index->entries || !index->cstates || !index->freqs) {
+		trace_index_release(index);
+		return NULL;
+	}
+
+	return index;
+}
+
+static int trace_index_add(struct trace_index *index, uint64_t offset,
+			   uint64_t time, struct import_window *state)
+{
+	size_t n = index->nrentries, nrcpus = index->nrcpus;
+	void *tmp;
+
+	/* the arrays double when the count reaches a power of two */
+	if (n && !(n & (n - 1))) {
+		tmp = realloc(index->entries, 2 * n * sizeof(*index->entries));
+		if (!tmp)
+			return -1;
+		index->entries = tmp;
+
+		tmp = realloc(index->cstates,
+			      2 * n * nrcpus * sizeof(*index->cstates));
+		if (!tmp)
+			return -1;
+		index->cstates = tmp;
+
+		tmp = realloc(index->freqs,
+			      2 * n * nrcpus * sizeof(*index->freqs));
+		if (!tmp)
+			return -1;
+		index->freqs = tmp;
+	}
+
+	index->entries[n].offset = offset;
+	index->entries[n].time = time;
+	memcpy(&index->cstates[n * nrcpus], state->cstate,
+	       nrcpus * sizeof(*index->cstates));
+	memcpy(&index->freqs[n * nrcpus], state->freq,
+	       nrcpus * sizeof(*index->freqs));
+	index->nrentries++;
+
+	return 0;
+}
+
+/* walk the whole trace once, following the state of the CPUs */
+static struct trace_index *trace_index_build(struct trace_file *tf,
+					     int nrcpus)
+{
+	const char *line, *end, *eols[SCAN_LINES_BATCH];
+	struct trace_index *index;
+	struct import_window state;
+	struct trace_event ev;
+	uint64_t next;
+	size_t i, n;
+
+	index = trace_index_alloc(nrcpus, 0);
+	if (!index)
+		return NULL;
+
+	if (import_window_init(&state, 0, UINT64_MAX, nrcpus)) {
+		trace_index_release(index);
+		return NULL;
+	}
+
+	line = tf->map + MIN(tf->pos, tf->size);
+	end = tf->map + tf->size;
+	next = line - tf->map;
+
+	while (line < end) {
+		n = scan_lines(line, end, eols, SCAN_LINES_BATCH);
+		if (!n)
+			eols[n++] = end;
+		spill_account(eols[n - 1] - line);
+
+		for (i = 0; i < n; line = eols[i++] + 1) {
+			if (parse_trace_line(line, eols[i] - line, &ev) ||
+			    ev.cpu >= nrcpus)
+				continue;
+
+			if (line - tf->map >= next) {
+				if (trace_index_add(index, line - tf->map,
+						    ev.time, &state))
+					goto error;
+				next = line - tf->map + INDEX_STRIDE;
+			}
+
+			import_window_track(&state, &ev);
+		}
+	}
+
+	import_window_release(&state);
+
+	return index;
+
+error:
+	import_window_release(&state);
+	trace_index_release(index);
+
+	return NULL;
+}
+
+static char *trace_index_path(const char *path)
+{
+	char *ipath;
+
+	if (asprintf(&ipath, "%s" INDEX_SUFFIX, path) < 0)
+		return NULL;
+
+	return ipath;
+}
+
+static struct trace_index *trace_index_load(const char *path,
+					    struct cache_key *key,
+					    int nrcpus)
+{
+	struct trace_index *index = NULL;
+	struct index_header header;
+	size_t n;
+	char *ipath;
+	FILE *f;
+
+	ipath = trace_index_path(path);
+	if (!ipath)
+		return NULL;
+
+	f = fopen(ipath, "r");
+	free(ipath);
+	if (!f)
+		return NULL;
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) ||
+	    header.version != INDEX_VERSION || header.nrcpus != nrcpus ||
+	    memcmp(&header.key, key, sizeof(*key)))
+		goto out;
+
+	/* an entry every INDEX_STRIDE bytes of trace at most */
+	n = header.nrentries;
+	if (n > key->size / INDEX_STRIDE + 1)
+		goto out;
+
+	index = trace_index_alloc(nrcpus, n);
+	if (!index)
+		goto out;
+
+	if (fread(index->entries, sizeof(*index->entries), n, f) != n ||
+	    fread(index->cstates, sizeof(*index->cstates) * nrcpus, n, f) != n ||
+	    fread(index->freqs, sizeof(*index->freqs) * nrcpus, n, f) != n) {
+		trace_index_release(index);
+		index = NULL;
+	}
+out:
+	fclose(f);
+
+	return index;
+}
+
+static int trace_index_store(const char *path, struct trace_index *index)
+{
+	struct index_header header;
+	size_t n = index->nrentries, nrcpus = index->nrcpus;
+	char *ipath;
+	FILE *f;
+	int ret;
+
+	ipath = trace_index_path(path);
+	if (!ipath)
+		return -1;
+
+	f = fopen(ipath, "w");
+	if (!f) {
+		free(ipath);
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header.version = INDEX_VERSION;
+	header.nrcpus = nrcpus;
+	header.key = index->key;
+	header.nrentries = n;
+
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(index->entries, sizeof(*index->entries), n, f);
+	fwrite(index->cstates, sizeof(*index->cstates) * nrcpus, n, f);
+	fwrite(index->freqs, sizeof(*index->freqs) * nrcpus, n, f);
+
+	ret = ferror(f) ? -1 : 0;
+	if (fclose(f))
+		ret = -1;
+
+	/* a partial index must not be read */
+	if (ret)
+		unlink(ipath);
+	free(ipath);
+
+	return ret;
+}
+
+/**
+ * trace_index_get - load the index of a trace, or build it
+ * @path: the trace file
+ * @tf: the trace, mapped and positioned at the first event line
+ * @nrcpus: the number of CPUs
+ * @nocache: build the index in memory, without reading or saving it
+ *
+ * The index is built by walking the whole trace the first time and is
+ * then saved next to the trace.
+ *
+ * Return: the index or NULL on error
+ */
+struct trace_index *trace_index_get(const char *path, struct trace_file *tf,
+				    int nrcpus, bool nocache)
+{
+	struct trace_index *index;
+	struct cache_key key;
+
+	if (!tf->map)
+		return NULL;
+
+	if (nocache)
+		return trace_index_build(tf, nrcpus);
+
+	/* the trace as it was opened, like the statistics cache */
+	if (cache_key_stat(path, &tf->stat, tf->size, &key))
+		return NULL;
+
+	index = trace_index_load(path, &key, nrcpus);
+	if (index)
+		return index;
+
+	index = trace_index_build(tf, nrcpus);
+	if (!index)
+		return NULL;
+
+	index->key = key;
+	if (trace_index_store(path, index))
+		fprintf(stderr, "warning: failed to save the index of '%s'\n",
+			path);
+
+	return index;
+}
+
+/**
+ * trace_index_seek - find where to start reading the trace for a window
+ * @index: the index
+ * @time: the beginning of the window, in nanoseconds
+ * @window: the window, its CPU states are set to the ones at the offset
+ *
+ * Return: the offset of the last indexed line before @time, 0 if there
+ * is none and the trace must be read from its beginning
+ */
+size_t trace_index_seek(struct trace_index *index, uint64_t time,
+			struct import_window *window)
+{
+	size_t lo = 0, hi = index->nrentries, mid;
+	int nrcpus = index->nrcpus;
+
+	/* the last entry before time, the lines at time may precede it */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->entries[mid].time < time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (!lo)
+		return 0;
+
+	memcpy(window->cstate, &index->cstates[(lo - 1) * nrcpus],
+	       nrcpus * sizeof(*window->cstate));
+	memcpy(window->freq, &index->freqs[(lo - 1) * nrcpus],
+	       nrcpus * sizeof(*window->freq));
+
+	return index->entries[lo - 1].offset;
+}
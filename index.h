@@ -0,0 +1,65 @@
+/*
+ *  index.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __INDEX_H
+#define __INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "import.h"
+#include "tracefile.h"
+
+/* the index of a trace is stored next to it, under this suffix */
+#define INDEX_SUFFIX ".idlestat-index"
+
+/* distance between two entries of the index, in bytes of trace */
+#define INDEX_STRIDE (4 << 20)
+
+/*
+ * A sparse index of a text trace: every INDEX_STRIDE bytes, the offset
+ * and the time of an event line, with the C-state and the frequency of
+ * each CPU right before it.
+ */
+struct trace_index_entry {
+	uint64_t offset;
+	uint64_t time;
+};
+
+struct trace_index {
+	struct cache_key key;
+	int nrcpus;
+	size_t nrentries;
+	struct trace_index_entry *entries;
+	int32_t *cstates;	/* nrcpus per entry */
+	uint32_t *freqs;
+};
+
+extern struct trace_index *trace_index_get(const char *path,
+					   struct trace_file *tf,
+					   int nrcpus, bool nocache);
+extern size_t trace_index_seek(struct trace_index *index, uint64_t time,
+			       struct import_window *window);
+extern void trace_index_release(struct trace_index *index);
+
+#endif
@@ -0,0 +1,707 @@
+/*
+ *  interval.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "interval.h"
+
+/* the largest encoding of an interval, two 64-bit varints */
+#define VARINT_MAX 10
+#define PACKED_INTERVAL_MAX (2 * VARINT_MAX)
+
+/**
+ * cstate_chunk_slot - get the chunk storing an interval of a C-state
+ * @c: the C-state
+ * @i: the interval index, at most the number of intervals
+ * @arena: the arena the chunks are allocated from
+ *
+ * Return: the chunk or NULL if out of memory
+ */
+struct cpuidle_chunk *cstate_chunk_slot(struct cpuidle_cstate *c, int i,
+					struct arena *arena)
+{
+	int chunk = i >> CPUIDLE_DATA_CHUNK_SHIFT;
+	struct cpuidle_chunk **data;
+
+	arena->nritems++;
+
+	if (chunk < c->nrchunks)
+		return c->data[chunk];
+
+	if (!(c->nrchunks & (c->nrchunks - 1))) {
+		data = arena_alloc(arena, MAX(2 * c->nrchunks, 1) *
+				   sizeof(*data));
+		if (!data)
+			return NULL;
+		if (c->nrchunks)
+			memcpy(data, c->data, c->nrchunks * sizeof(*data));
+		c->data = data;
+	}
+
+	c->data[chunk] = arena_alloc(arena, sizeof(**c->data));
+	if (!c->data[chunk])
+		return NULL;
+	c->nrchunks++;
+
+	return c->data[chunk];
+}
+
+static int varint_encode(unsigned char *p, uint64_t value)
+{
+	int len = 0;
+
+	while (value >= 0x80) {
+		p[len++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	p[len++] = value;
+
+	return len;
+}
+
+/*
+ * In compact mode, the intervals are appended to the last block of the
+ * list. The time between the end of the previous interval and the
+ * beginning of the next one, and the durations, take 2 to 4 bytes most
+ * of the time instead of the 16 of a struct cpuidle_data.
+ */
+static int cstate_pack(struct cpuidle_cstate *c, struct cpuidle_data *data,
+		       struct arena *arena)
+{
+	struct cpuidle_pack *pack = c->last_pack;
+	unsigned char *p;
+
+	if (!pack || pack->len > CPUIDLE_PACK_SIZE - PACKED_INTERVAL_MAX) {
+		pack = arena_alloc(arena, sizeof(*pack));
+		if (!pack)
+			return -1;
+
+		if (c->last_pack) {
+			pack->base = pack->end = c->last_pack->end;
+			c->last_pack->next = pack;
+		} else
+			c->packs = pack;
+		c->last_pack = pack;
+	}
+
+	p = pack->data + pack->len;
+	p += varint_encode(p, data->begin - pack->end);
+	p += varint_encode(p, data->end - data->begin);
+	pack->len = p - pack->data;
+	pack->end = data->end;
+	pack->count++;
+
+	arena->nritems++;
+
+	return 0;
+}
+
+/**
+ * cstate_add - append a closed interval to a C-state
+ * @c: the C-state
+ * @data: the interval, beginning after the end of the last one
+ * @arena: the arena the storage is allocated from
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int cstate_add(struct cpuidle_cstate *c, struct cpuidle_data *data,
+	       struct arena *arena)
+{
+	struct cpuidle_chunk *chunk;
+
+	if (c->compact) {
+		if (cstate_pack(c, data, arena))
+			return -1;
+	} else {
+		chunk = cstate_chunk_slot(c, c->nrdata, arena);
+		if (!chunk)
+			return -1;
+		chunk->begin[CHUNK_INDEX(c->nrdata)] = data->begin;
+		chunk->end[CHUNK_INDEX(c->nrdata)] = data->end;
+	}
+
+	c->nrdata++;
+
+	return 0;
+}
+
+/**
+ * cstate_open - record the beginning of an idle period
+ * @c: the C-state entered
+ * @time: the entry time
+ * @arena: the arena the storage is allocated from
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int cstate_open(struct cpuidle_cstate *c, uint64_t time, struct arena *arena)
+{
+	struct cpuidle_chunk *chunk;
+
+	if (c->compact) {
+		c->open = time;
+		return 0;
+	}
+
+	chunk = cstate_chunk_slot(c, c->nrdata, arena);
+	if (!chunk)
+		return -1;
+
+	chunk->begin[CHUNK_INDEX(c->nrdata)] = time;
+
+	return 0;
+}
+
+/**
+ * cstate_close - record the end of the idle period opened last
+ * @c: the C-state exited
+ * @time: the exit time
+ * @data: filled with the idle period
+ * @arena: the arena the storage is allocated from
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int cstate_close(struct cpuidle_cstate *c, uint64_t time,
+		 struct cpuidle_data *data, struct arena *arena)
+{
+	struct cpuidle_chunk *chunk;
+	int i = CHUNK_INDEX(c->nrdata);
+
+	if (c->compact) {
+		data->begin = c->open;
+		/* the timestamps of a CPU never go backward, but a corrupted
+		 * trace must not wrap the duration around */
+		data->end = MAX(time, data->begin);
+		if (cstate_pack(c, data, arena))
+			return -1;
+	} else {
+		chunk = cstate_chunk(c, c->nrdata);
+		chunk->end[i] = MAX(time, chunk->begin[i]);
+		data->begin = chunk->begin[i];
+		data->end = chunk->end[i];
+	}
+
+	c->nrdata++;
+
+	return 0;
+}
+
+/**
+ * cstate_summarize - compute the statistics of the intervals of a C-state
+ * @c: the C-state
+ * @low: the durations below it are counted in @s->below
+ * @high: the durations reaching it, and @low, are counted in @s->above
+ * @s: filled with the statistics
+ *
+ * The chunks are summarized in place, the packed intervals are decoded
+ * into columns first.
+ */
+void cstate_summarize(struct cpuidle_cstate *c, int64_t low, int64_t high,
+		      struct interval_summary *s)
+{
+	uint64_t begin[CPUIDLE_DATA_CHUNK], end[CPUIDLE_DATA_CHUNK];
+	struct cpuidle_data data;
+	struct cstate_iter it;
+	int i, n;
+
+	interval_summary_init(s);
+
+	if (!c->compact) {
+		for (i = 0; i < c->nrdata; i += n) {
+			n = MIN(c->nrdata - i, CPUIDLE_DATA_CHUNK);
+			spill_touch(cstate_chunk(c, i), sizeof(struct cpuidle_chunk));
+			interval_summary_add(s, cstate_chunk(c, i)->begin,
+					     cstate_chunk(c, i)->end, n,
+					     low, high);
+		}
+		return;
+	}
+
+	cstate_iter_init(&it, c);
+	do {
+		for (n = 0; n < CPUIDLE_DATA_CHUNK &&
+			    cstate_iter_next(&it, &data); n++) {
+			begin[n] = data.begin;
+			end[n] = data.end;
+		}
+		interval_summary_add(s, begin, end, n, low, high);
+	} while (n == CPUIDLE_DATA_CHUNK);
+}
+
+/*
+ * Move the iterator to the first interval ending after @time and return
+ * it. The ends are ordered like the intervals: the columns are searched
+ * by galloping from the current interval, the packed intervals skip the
+ * blocks ending before @time.
+ */
+static bool cstate_iter_seek(struct cstate_iter *it, uint64_t time,
+			     struct cpuidle_data *data)
+{
+	struct cpuidle_cstate *c = it->c;
+	int lo = it->i, hi = it->i, mid, step = 1;
+
+	if (!c->compact) {
+		while (hi < c->nrdata &&
+		       cstate_chunk(c, hi)->end[CHUNK_INDEX(hi)] <= time) {
+			lo = hi + 1;
+			hi += step;
+			step *= 2;
+		}
+
+		hi = MIN(hi, c->nrdata);
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (cstate_chunk(c, mid)->end[CHUNK_INDEX(mid)] <= time)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		it->i = lo;
+
+		return cstate_iter_next(it, data);
+	}
+
+	while (it->i < c->nrdata && it->pack->end <= time) {
+		it->i += it->left;
+		if (!it->pack->next)
+			break;
+		it->pack = it->pack->next;
+		it->pos = 0;
+		it->left = it->pack->count;
+		it->end = it->pack->base;
+	}
+
+	while (cstate_iter_next(it, data))
+		if (data->end > time)
+			return true;
+
+	return false;
+}
+
+/*
+ * The intervals common to several C-states are found in a single sweep.
+ * Each C-state has a cursor on its current interval and the heap holds
+ * the cursors keyed by the end of that interval. The common part of the
+ * current intervals goes from the latest beginning to the earliest end,
+ * then the interval ending first is replaced by the next one of its
+ * C-state. When that interval ends before the latest beginning, all the
+ * intervals of its C-state which can not reach it are skipped at once.
+ * Sweeping N intervals of K C-states costs at most O(N log K) and
+ * nothing is allocated per interval but the storage of the result.
+ */
+struct sweep_cursor {
+	struct cstate_iter it;
+	struct cpuidle_data data;
+};
+
+static void sweep_sift_down(struct sweep_cursor **heap, int n, int i)
+{
+	struct sweep_cursor *cursor = heap[i];
+	int child;
+
+	for (; (child = 2 * i + 1) < n; i = child) {
+		child += child + 1 < n &&
+			 heap[child + 1]->data.end < heap[child]->data.end;
+
+		if (heap[child]->data.end >= cursor->data.end)
+			break;
+
+		heap[i] = heap[child];
+	}
+
+	heap[i] = cursor;
+}
+
+static int cstate_sweep(struct cpuidle_cstate *result,
+			struct cpuidle_cstate **cs, int n, struct arena *arena)
+{
+	struct sweep_cursor *cursors, **heap, *first;
+	struct cpuidle_data interval;
+	uint64_t begin = 0;
+	int i, ret = -1;
+
+	cursors = malloc(n * sizeof(*cursors));
+	heap = malloc(n * sizeof(*heap));
+	if (!cursors || !heap)
+		goto out;
+
+	for (i = 0; i < n; i++) {
+		cstate_iter_init(&cursors[i].it, cs[i]);
+
+		/* a C-state without interval has nothing in common */
+		if (!cstate_iter_next(&cursors[i].it, &cursors[i].data)) {
+			ret = 0;
+			goto out;
+		}
+
+		begin = MAX(begin, cursors[i].data.begin);
+		heap[i] = &cursors[i];
+	}
+
+	for (i = n / 2 - 1; i >= 0; i--)
+		sweep_sift_down(heap, n, i);
+
+	while (n) {
+		first = heap[0];
+
+		if (first->data.end <= begin) {
+			if (!cstate_iter_seek(&first->it, begin, &first->data))
+				break;
+		} else {
+			interval.begin = begin;
+			interval.end = first->data.end;
+			if (cstate_add(result, &interval, arena))
+				goto out;
+
+			if (!cstate_iter_next(&first->it, &first->data))
+				break;
+		}
+
+		/* the beginnings only move forward, so does their max */
+		begin = MAX(begin, first->data.begin);
+		sweep_sift_down(heap, n, 0);
+	}
+
+	ret = 0;
+out:
+	free(cursors);
+	free(heap);
+
+	return ret;
+}
+
+/**
+ * cstate_intersect - store the intervals common to several C-states
+ * @result: the C-state receiving the intervals
+ * @cs: the C-states, their intervals are ordered and do not overlap
+ * @n: number of C-states
+ * @arena: the arena the intervals of @result are allocated from
+ *
+ * The intervals are stored in time order and do not overlap either, so
+ * @result can be intersected in turn.
+ *
+ * When the first two of many C-states have few intervals in common,
+ * the CPUs are idle independently and the intersection quickly gets
+ * empty: the C-states are then folded in pairs, which stops as soon as
+ * nothing is left, instead of moving all the cursors of the sweep to
+ * the end. Otherwise the common intervals of the first two take their
+ * place in the sweep.
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int cstate_intersect(struct cpuidle_cstate *result, struct cpuidle_cstate **cs,
+		     int n, struct arena *arena)
+{
+	struct cpuidle_cstate acc[2], *pair[2], **pcs;
+	struct arena tmp[2];
+	int i, cur = 0, ret = -1;
+
+	/* a few C-states are cheap to sweep, whatever their intervals */
+	if (n < 8)
+		return cstate_sweep(result, cs, n, arena);
+
+	memset(acc, 0, sizeof(acc));
+	memset(tmp, 0, sizeof(tmp));
+	acc[0].compact = acc[1].compact = result->compact;
+
+	if (cstate_sweep(&acc[0], cs, 2, &tmp[0]))
+		goto out;
+
+	/* the common intervals of the first two replace them in the sweep */
+	if (2 * acc[0].nrdata >= MIN(cs[0]->nrdata, cs[1]->nrdata)) {
+		pcs = malloc((n - 1) * sizeof(*pcs));
+		if (!pcs)
+			goto out;
+
+		pcs[0] = &acc[0];
+		memcpy(&pcs[1], &cs[2], (n - 2) * sizeof(*pcs));
+		ret = cstate_sweep(result, pcs, n - 1, arena);
+		free(pcs);
+		goto out;
+	}
+
+	for (i = 2; acc[cur].nrdata; i++) {
+		pair[0] = &acc[cur];
+		pair[1] = cs[i];
+
+		if (i == n - 1) {
+			ret = cstate_sweep(result, pair, 2, arena);
+			goto out;
+		}
+
+		if (cstate_sweep(&acc[!cur], pair, 2, &tmp[!cur]))
+			goto out;
+
+		arena_release(&tmp[cur]);
+		memset(&acc[cur], 0, sizeof(acc[cur]));
+		acc[cur].compact = result->compact;
+		cur = !cur;
+	}
+
+	/* nothing in common */
+	ret = 0;
+out:
+	arena_release(&tmp[0]);
+	arena_release(&tmp[1]);
+
+	return ret;
+}
+
+/*
+ * The depth of a CPU is the C-state it is in, -1 while it runs. A group
+ * of CPUs is at depth k or deeper while all its CPUs are, the shallowest
+ * one sets the limit. The intervals of all the C-states of each CPU are
+ * walked in time order as a sequence of depth changes, and the heap
+ * merges the changes of the CPUs. Counting the CPUs at each depth gives
+ * the intervals of the group for all the depths in one sweep.
+ */
+struct depth_cursor {
+	struct cstate_iter it[MAXCSTATE];
+	struct cpuidle_data next[MAXCSTATE];	/* of each C-state */
+	unsigned int left;		/* the C-states with a next interval */
+	struct cpuidle_data data;	/* the current interval */
+	int state;			/* of the current interval */
+	bool idle;			/* the interval has begun */
+	uint64_t time;			/* of the next depth change */
+};
+
+/* move to the next interval of the CPU, whatever its C-state */
+static bool depth_cursor_fetch(struct depth_cursor *cur)
+{
+	unsigned int left;
+	int i, state = -1;
+
+	for (left = cur->left; left; left &= left - 1) {
+		i = __builtin_ctz(left);
+		if (state < 0 || cur->next[i].begin < cur->next[state].begin)
+			state = i;
+	}
+
+	if (state < 0)
+		return false;
+
+	cur->data = cur->next[state];
+	cur->state = state;
+	cur->idle = false;
+	cur->time = cur->data.begin;
+
+	if (!cstate_iter_next(&cur->it[state], &cur->next[state]))
+		cur->left &= ~(1U << state);
+
+	return true;
+}
+
+static void depth_sift_down(struct depth_cursor **heap, int n, int i)
+{
+	struct depth_cursor *cursor = heap[i];
+	int child;
+
+	for (; (child = 2 * i + 1) < n; i = child) {
+		child += child + 1 < n &&
+			 heap[child + 1]->time < heap[child]->time;
+
+		if (heap[child]->time >= cursor->time)
+			break;
+
+		heap[i] = heap[child];
+	}
+
+	heap[i] = cursor;
+}
+
+/**
+ * cstates_depth_sweep - compute the residency of a group of CPUs by depth
+ * @result: filled with the statistics, the state k holds the intervals
+ * where all the CPUs were in the state k or in a deeper one
+ * @cpus: the C-states of the CPUs
+ * @n: number of CPUs
+ *
+ * The intervals of the group are accounted, not stored.
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int cstates_depth_sweep(struct cpuidle_cstates *result,
+			struct cpuidle_cstates **cpus, int n)
+{
+	struct depth_cursor *cursors, **heap, *cur;
+	uint64_t begin[MAXCSTATE];
+	int deep[MAXCSTATE] = { 0 };
+	int i, k, ret = -1;
+
+	for (k = 0; k < MAXCSTATE; k++)
+		result->cstate[k].min_time = UINT64_MAX;
+
+	cursors = calloc(n, sizeof(*cursors));
+	heap = malloc(n * sizeof(*heap));
+	if (!cursors || !heap)
+		goto out;
+
+	for (i = 0; i < n; i++) {
+		cur = &cursors[i];
+
+		for (k = 0; k <= cpus[i]->cstate_max; k++) {
+			cstate_iter_init(&cur->it[k], &cpus[i]->cstate[k]);
+			if (cstate_iter_next(&cur->it[k], &cur->next[k]))
+				cur->left |= 1U << k;
+		}
+
+		/* a CPU never idle keeps the group running */
+		if (!depth_cursor_fetch(cur)) {
+			ret = 0;
+			goto out;
+		}
+
+		heap[i] = cur;
+	}
+
+	for (i = n / 2 - 1; i >= 0; i--)
+		depth_sift_down(heap, n, i);
+
+	while (n) {
+		cur = heap[0];
+
+		if (!cur->idle) {
+			for (k = 0; k <= cur->state; k++)
+				if (++deep[k] == n)
+					begin[k] = cur->time;
+
+			cur->idle = true;
+			cur->time = cur->data.end;
+		} else {
+			for (k = 0; k <= cur->state; k++)
+				if (deep[k]-- == n && begin[k] < cur->time)
+					cstate_account(&result->cstate[k],
+						       cur->time - begin[k]);
+
+			/* the CPU runs until the end of the trace */
+			if (!depth_cursor_fetch(cur))
+				break;
+		}
+
+		depth_sift_down(heap, n, 0);
+	}
+
+	ret = 0;
+out:
+	free(cursors);
+	free(heap);
+
+	return ret;
+}
+
+static inline void concurrency_change(struct idle_concurrency *g,
+				      uint64_t time, int delta)
+{
+	g->time[g->idle] += time - g->last;
+	g->last = time;
+	g->idle += delta;
+}
+
+/**
+ * cstates_concurrency_sweep - compute how many CPUs were idle together
+ * @cpus: the C-states of the CPUs
+ * @groups: the group of each CPU, NULL if it belongs to none
+ * @n: number of CPUs
+ * @all: the group of all the CPUs
+ *
+ * The idle entries and exits of all the CPUs are merged in one sweep,
+ * from the first entry to the last exit. The histograms of the groups
+ * are allocated by the caller and zeroed.
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int cstates_concurrency_sweep(struct cpuidle_cstates **cpus,
+			      struct idle_concurrency **groups, int n,
+			      struct idle_concurrency *all)
+{
+	struct depth_cursor *cursors, **heap, *cur;
+	struct idle_concurrency *g;
+	int i, k, m = 0, ret = -1;
+	uint64_t time;
+
+	cursors = calloc(n, sizeof(*cursors));
+	heap = malloc(n * sizeof(*heap));
+	if (!cursors || !heap)
+		goto out;
+
+	for (i = 0; i < n; i++) {
+		cur = &cursors[i];
+
+		for (k = 0; k <= cpus[i]->cstate_max; k++) {
+			cstate_iter_init(&cur->it[k], &cpus[i]->cstate[k]);
+			if (cstate_iter_next(&cur->it[k], &cur->next[k]))
+				cur->left |= 1U << k;
+		}
+
+		if (depth_cursor_fetch(cur))
+			heap[m++] = cur;
+	}
+
+	ret = 0;
+	if (!m)
+		goto out;
+
+	for (i = m / 2 - 1; i >= 0; i--)
+		depth_sift_down(heap, m, i);
+
+	/* the groups start together, with all their CPUs running */
+	time = heap[0]->time;
+	all->last = time;
+	for (i = 0; i < n; i++)
+		if (groups[i])
+			groups[i]->last = time;
+
+	while (m) {
+		cur = heap[0];
+		g = groups[cur - cursors];
+		time = cur->time;
+
+		if (!cur->idle) {
+			concurrency_change(all, time, 1);
+			if (g)
+				concurrency_change(g, time, 1);
+
+			cur->idle = true;
+			cur->time = cur->data.end;
+		} else {
+			concurrency_change(all, time, -1);
+			if (g)
+				concurrency_change(g, time, -1);
+
+			if (!depth_cursor_fetch(cur))
+				heap[0] = heap[--m];
+		}
+
+		if (m)
+			depth_sift_down(heap, m, 0);
+	}
+
+	/* and end together, at the last exit */
+	for (i = 0; i < n; i++)
+		if (groups[i])
+			concurrency_change(groups[i], time, 0);
+out:
+	free(cursors);
+	free(heap);
+
+	return ret;
+}
@@ -0,0 +1,156 @@
+/*
+ *  interval.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __INTERVAL_H
+#define __INTERVAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "idlestat.h"
+#include "arena.h"
+#include "summary.h"
+#include "spill.h"
+
+static inline struct cpuidle_chunk *cstate_chunk(struct cpuidle_cstate *c,
+						 int i)
+{
+	return c->data[i >> CPUIDLE_DATA_CHUNK_SHIFT];
+}
+
+#define CHUNK_INDEX(i) ((i) & (CPUIDLE_DATA_CHUNK - 1))
+
+/*
+ * The time a group of CPUs spent with exactly k of them idle, whatever
+ * their C-state, for k from 0 to the number of CPUs of the group.
+ */
+struct idle_concurrency {
+	int nrcpus;
+	uint64_t *time;			/* nrcpus + 1 entries */
+	int idle;			/* sweep: CPUs idle now */
+	uint64_t last;			/* sweep: time of the last change */
+};
+
+/* account an interval in the statistics of a C-state not storing it */
+static inline void cstate_account(struct cpuidle_cstate *c, uint64_t duration)
+{
+	c->nrdata++;
+	c->min_time = MIN(c->min_time, duration);
+	c->max_time = MAX(c->max_time, duration);
+	c->duration += duration;
+}
+
+extern struct cpuidle_chunk *cstate_chunk_slot(struct cpuidle_cstate *c,
+					       int i, struct arena *arena);
+extern int cstate_open(struct cpuidle_cstate *c, uint64_t time,
+		       struct arena *arena);
+extern int cstate_close(struct cpuidle_cstate *c, uint64_t time,
+			struct cpuidle_data *data, struct arena *arena);
+extern int cstate_add(struct cpuidle_cstate *c, struct cpuidle_data *data,
+		      struct arena *arena);
+extern int cstate_intersect(struct cpuidle_cstate *result,
+			    struct cpuidle_cstate **cs, int n,
+			    struct arena *arena);
+extern int cstates_depth_sweep(struct cpuidle_cstates *result,
+			       struct cpuidle_cstates **cpus, int n);
+extern int cstates_concurrency_sweep(struct cpuidle_cstates **cpus,
+				     struct idle_concurrency **groups, int n,
+				     struct idle_concurrency *all);
+extern void cstate_summarize(struct cpuidle_cstate *c, int64_t low,
+			     int64_t high, struct interval_summary *s);
+
+/*
+ * Walk the closed intervals of a C-state, whatever their storage. The
+ * iterator is a plain value, a copy of it resumes the walk from the same
+ * interval.
+ */
+struct cstate_iter {
+	struct cpuidle_cstate *c;
+	int i;				/* index of the next interval */
+	const struct cpuidle_pack *pack;
+	int pos;			/* offset of the next one in the block */
+	int left;			/* intervals left in the block */
+	uint64_t end;			/* end of the previous interval */
+};
+
+static inline void cstate_iter_init(struct cstate_iter *it,
+				    struct cpuidle_cstate *c)
+{
+	it->c = c;
+	it->i = 0;
+	it->pack = c->packs;
+	it->pos = 0;
+	it->left = c->packs ? c->packs->count : 0;
+	it->end = c->packs ? c->packs->base : 0;
+}
+
+static inline uint64_t varint_decode(const unsigned char **p)
+{
+	uint64_t value = 0;
+	int shift = 0;
+
+	while (**p & 0x80) {
+		value |= (uint64_t)(*(*p)++ & 0x7f) << shift;
+		shift += 7;
+	}
+
+	return value | (uint64_t)*(*p)++ << shift;
+}
+
+static inline bool cstate_iter_next(struct cstate_iter *it,
+				    struct cpuidle_data *data)
+{
+	const unsigned char *p;
+
+	if (it->i >= it->c->nrdata)
+		return false;
+
+	it->i++;
+
+	if (!it->c->compact) {
+		struct cpuidle_chunk *chunk = cstate_chunk(it->c, it->i - 1);
+
+		if (!CHUNK_INDEX(it->i - 1))
+			spill_touch(chunk, sizeof(*chunk));
+		data->begin = chunk->begin[CHUNK_INDEX(it->i - 1)];
+		data->end = chunk->end[CHUNK_INDEX(it->i - 1)];
+		return true;
+	}
+
+	if (!it->left) {
+		it->pack = it->pack->next;
+		it->pos = 0;
+		it->left = it->pack->count;
+		it->end = it->pack->base;
+		spill_touch(it->pack, sizeof(*it->pack));
+	}
+
+	p = it->pack->data + it->pos;
+	data->begin = it->end + varint_decode(&p);
+	data->end = data->begin + varint_decode(&p);
+	it->pos = p - it->pack->data;
+	it->left--;
+	it->end = data->end;
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ *  merge.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#include <stdlib.h>
+
+#include "merge.h"
+
+/*
+ * Merge several time ordered event streams into one. The heap holds the
+ * streams having an event left, the root is the stream with the oldest
+ * one. Each step only refills the root and sifts it down, so merging N
+ * events from K streams costs O(N log K) and no event is copied.
+ */
+
+/*
+ * The comparisons are unpredictable, they are written without branch so
+ * the compiler can use conditional moves.
+ */
+static inline int node_before(struct event_merge_node *a,
+			      struct event_merge_node *b)
+{
+	return (a->time < b->time) |
+		((a->time == b->time) & (a->id < b->id));
+}
+
+static void sift_down(struct event_merge *merge, int i)
+{
+	struct event_merge_node *heap = merge->heap, node = heap[i];
+	int child;
+
+	for (; (child = 2 * i + 1) < merge->nrsources; i = child) {
+		child += child + 1 < merge->nrsources &&
+			 node_before(&heap[child + 1], &heap[child]);
+
+		if (!node_before(&heap[child], &node))
+			break;
+
+		heap[i] = heap[child];
+	}
+
+	heap[i] = node;
+}
+
+/* read the next event of the source into the node */
+static inline int node_fill(struct event_merge_node *node)
+{
+	node->ev = node->src->next(node->src);
+	if (!node->ev)
+		return -1;
+
+	node->time = node->ev->time;
+
+	return 0;
+}
+
+/**
+ * event_merge_init - prepare the merge of several event streams
+ * @merge: the merge to initialize
+ * @sources: the streams, their first event is read here
+ * @nrsources: number of streams
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int event_merge_init(struct event_merge *merge,
+		     struct event_source **sources, int nrsources)
+{
+	struct event_merge_node *node;
+	int i;
+
+	merge->heap = malloc(sizeof(*merge->heap) * (nrsources + 1));
+	if (!merge->heap)
+		return -1;
+
+	merge->nrsources = 0;
+	merge->started = 0;
+
+	for (i = 0; i < nrsources; i++) {
+		node = &merge->heap[merge->nrsources];
+		node->src = sources[i];
+		node->id = sources[i]->id;
+		if (!node_fill(node))
+			merge->nrsources++;
+	}
+
+	for (i = merge->nrsources / 2 - 1; i >= 0; i--)
+		sift_down(merge, i);
+
+	return 0;
+}
+
+/**
+ * event_merge_next - get the oldest event of all the streams
+ * @merge: the merge
+ *
+ * The event is valid until the next call.
+ *
+ * Return: the event or NULL when all the streams are exhausted
+ */
+struct trace_event *event_merge_next(struct event_merge *merge)
+{
+	if (!merge->nrsources)
+		return NULL;
+
+	/* the root was returned by the previous call, move it forward */
+	if (merge->started) {
+		if (node_fill(&merge->heap[0]))
+			merge->heap[0] = merge->heap[--merge->nrsources];
+		sift_down(merge, 0);
+	}
+
+	merge->started = 1;
+
+	return merge->nrsources ? merge->heap[0].ev : NULL;
+}
+
+void event_merge_release(struct event_merge *merge)
+{
+	free(merge->heap);
+	merge->heap = NULL;
+	merge->nrsources = 0;
+}
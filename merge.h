@@ -0,0 +1,59 @@
+/*
+ *  merge.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __MERGE_H
+#define __MERGE_H
+
+#include <stdint.h>
+
+#include "parser.h"
+
+/*
+ * A time ordered stream of events, usually the events recorded on one
+ * CPU. next() returns the following event, which must stay valid until
+ * the next call, or NULL when the stream is exhausted.
+ */
+struct event_source {
+	struct trace_event *(*next)(struct event_source *src);
+	int id;			/* orders the events with the same time */
+};
+
+/* the heap holds the ordering key, the sources are not touched to sift */
+struct event_merge_node {
+	uint64_t time;
+	int id;
+	struct trace_event *ev;
+	struct event_source *src;
+};
+
+/* a binary min-heap of the sources, keyed by the time of their event */
+struct event_merge {
+	struct event_merge_node *heap;
+	int nrsources;
+	int started;
+};
+
+extern int event_merge_init(struct event_merge *merge,
+			    struct event_source **sources, int nrsources);
+extern struct trace_event *event_merge_next(struct event_merge *merge);
+extern void event_merge_release(struct event_merge *merge);
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ *  parser.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+
+#include "parser.h"
+#include "scan.h"
+
+/*
+ * The lines produced by the kernel in the 'trace' file and by
+ * 'trace-cmd report' look like:
+ *
+ *   <idle>-0     [001] d..2   123.456789: cpu_idle: state=1 cpu_id=1
+ *   <idle>-0     [000] d.h2   123.456800: irq_handler_entry: irq=27 name=timer
+ *   <idle>-0     [001] d.h2   123.456900: ipi_entry: (Rescheduling interrupts)
+ *
+ * where the irq-info column ("d..2") is optional. The parser below walks
+ * the line once from left to right, it does not need the line to be
+ * NUL-terminated and never converts the timestamp to a floating point.
+ */
+
+static inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline const char *skip_blanks(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	return p;
+}
+
+static inline const char *parse_uint(const char *p, const char *end,
+				     unsigned int *value)
+{
+	unsigned int val = 0;
+
+	if (p >= end || !is_digit(*p))
+		return NULL;
+
+	/* a value which does not fit is not wrapped around */
+	while (p < end && is_digit(*p)) {
+		if (val > (UINT_MAX - (*p - '0')) / 10)
+			return NULL;
+		val = val * 10 + *p++ - '0';
+	}
+
+	*value = val;
+
+	return p;
+}
+
+/* parse "<seconds>.<fraction>:" into nanoseconds */
+static const char *parse_timestamp(const char *p, const char *end,
+				   uint64_t *time)
+{
+	uint64_t sec = 0, nsec = 0, scale = NSEC_PER_SEC;
+
+	if (p >= end || !is_digit(*p))
+		return NULL;
+
+	while (p < end && is_digit(*p))
+		sec = sec * 10 + *p++ - '0';
+
+	if (p < end && *p == '.') {
+		for (p++; p < end && is_digit(*p); p++) {
+			/* digits beyond the nanosecond are dropped */
+			if (scale == 1)
+				continue;
+			scale /= 10;
+			nsec += (*p - '0') * scale;
+		}
+	}
+
+	if (p >= end || *p != ':')
+		return NULL;
+
+	*time = sec * NSEC_PER_SEC + nsec;
+
+	return p + 1;
+}
+
+/* skip to the value of the next "key=value" field */
+static inline const char *next_value(const char *p, const char *end)
+{
+	p = scan_char(p, end, '=');
+	return p ? p + 1 : NULL;
+}
+
+static void copy_name(char *name, const char *p, const char *end,
+		      const char *stop)
+{
+	size_t i;
+
+	for (i = 0; i < NAMELEN && p < end && !strchr(stop, *p); i++)
+		name[i] = *p++;
+	name[i] = '\0';
+}
+
+/* "state=%u cpu_id=%d" */
+static int parse_cpu_state(const char *p, const char *end,
+			   struct trace_event *ev)
+{
+	unsigned int cpu;
+
+	p = next_value(p, end);
+	if (!p)
+		return -1;
+
+	p = parse_uint(p, end, &ev->value);
+	if (!p)
+		return -1;
+
+	p = next_value(p, end);
+	if (!p || !parse_uint(p, end, &cpu) || cpu > INT_MAX)
+		return -1;
+
+	ev->cpu = cpu;
+
+	return 0;
+}
+
+/* "irq=%d name=%s" */
+static int parse_irq(const char *p, const char *end, struct trace_event *ev)
+{
+	p = next_value(p, end);
+	if (!p)
+		return -1;
+
+	p = parse_uint(p, end, &ev->value);
+	if (!p)
+		return -1;
+
+	p = next_value(p, end);
+	if (!p)
+		return -1;
+
+	copy_name(ev->name, p, end, " \t");
+
+	return 0;
+}
+
+/* "(%s)" */
+static int parse_ipi(const char *p, const char *end, struct trace_event *ev)
+{
+	p = scan_char(p, end, '(');
+	if (!p)
+		return -1;
+
+	copy_name(ev->name, p + 1, end, " \t)");
+	ev->value = -1;
+
+	return 0;
+}
+
+#define EVENT_DESC(_system, _name, _type, _optional, _parse, _f0, _f1)	\
+	{							\
+		.system = _system,				\
+		.name = _name,					\
+		.len = sizeof(_name) - 1,			\
+		.type = _type,					\
+		.optional = _optional,				\
+		.parse = _parse,				\
+		.fields = { _f0, _f1 },				\
+	}
+
+const struct event_desc event_descs[] = {
+	EVENT_DESC("power", "cpu_idle", EVENT_CPU_IDLE, 0, parse_cpu_state,
+		   "state", "cpu_id"),
+	EVENT_DESC("power", "cpu_frequency", EVENT_CPU_FREQUENCY, 0,
+		   parse_cpu_state, "state", "cpu_id"),
+	EVENT_DESC("irq", "irq_handler_entry", EVENT_IRQ, 0, parse_irq,
+		   "irq", "name"),
+	/* ipi events were added in Linux 3.16 */
+	EVENT_DESC("ipi", "ipi_entry", EVENT_IPI, 1, parse_ipi,
+		   "reason", NULL),
+	{ .name = NULL },
+};
+
+/*
+ * Open addressing hash of the event names, built once from the table
+ * above. Most of the lines of a trace are events idlestat does not know
+ * about, they are discarded after hashing the name and probing a slot.
+ */
+#define EVENT_HASH_SIZE 64
+
+static const struct event_desc *event_hash[EVENT_HASH_SIZE];
+
+static inline unsigned int event_hash_fn(const char *name, size_t len)
+{
+	return (len ^ ((unsigned char)name[0] << 1) ^
+		((unsigned char)name[len - 1] << 2)) &
+		(EVENT_HASH_SIZE - 1);
+}
+
+static void __attribute__((constructor)) event_hash_init(void)
+{
+	const struct event_desc *desc;
+	unsigned int i;
+
+	for_each_event_desc(desc) {
+		i = event_hash_fn(desc->name, desc->len);
+		while (event_hash[i])
+			i = (i + 1) & (EVENT_HASH_SIZE - 1);
+		event_hash[i] = desc;
+	}
+}
+
+/**
+ * event_desc_lookup - find the description of an event
+ * @name: the event name, not necessarily NUL-terminated
+ * @len: length of the name
+ *
+ * Return: the event description or NULL if the event is unknown
+ */
+const struct event_desc *event_desc_lookup(const char *name, size_t len)
+{
+	const struct event_desc *desc;
+	unsigned int i;
+
+	if (!len)
+		return NULL;
+
+	for (i = event_hash_fn(name, len); (desc = event_hash[i]);
+	     i = (i + 1) & (EVENT_HASH_SIZE - 1)) {
+		if (desc->len == len && !memcmp(desc->name, name, len))
+			return desc;
+	}
+
+	return NULL;
+}
+
+/**
+ * parse_trace_line - decode a trace line
+ * @line: the line, not necessarily NUL-terminated
+ * @len: length of the line
+ * @ev: the decoded event
+ *
+ * Return: 0 if the line holds an event idlestat knows about, -1
+ * otherwise
+ */
+int parse_trace_line(const char *line, size_t len, struct trace_event *ev)
+{
+	const char *p = line, *end = line + len, *name;
+	const struct event_desc *desc;
+	unsigned int cpu;
+
+	/* "[cpu]", the task name may contain any character except '[' */
+	p = scan_char(p, end, '[');
+	if (!p)
+		return -1;
+
+	p = parse_uint(p + 1, end, &cpu);
+	if (!p || p >= end || *p != ']' || cpu > INT_MAX)
+		return -1;
+	ev->cpu = cpu;
+
+	/* optional irq-info column followed by the timestamp */
+	p = skip_blanks(p + 1, end);
+	name = parse_timestamp(p, end, &ev->time);
+	if (!name) {
+		while (p < end && *p != ' ' && *p != '\t')
+			p++;
+		p = skip_blanks(p, end);
+		name = parse_timestamp(p, end, &ev->time);
+		if (!name)
+			return -1;
+	}
+
+	/* event name */
+	name = skip_blanks(name, end);
+	p = scan_char(name, end, ':');
+	if (!p)
+		return -1;
+
+	desc = event_desc_lookup(name, p - name);
+	if (!desc) {
+		ev->type = EVENT_UNKNOWN;
+		return -1;
+	}
+
+	ev->type = desc->type;
+
+	return desc->parse(p, end, ev);
+}
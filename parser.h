@@ -0,0 +1,78 @@
+/*
+ *  parser.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __PARSER_H
+#define __PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "idlestat.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+enum trace_event_type {
+	EVENT_UNKNOWN = 0,
+	EVENT_CPU_IDLE,
+	EVENT_CPU_FREQUENCY,
+	EVENT_IRQ,
+	EVENT_IPI,
+};
+
+/*
+ * An event decoded from a trace line. For the power events, the cpu is
+ * the one given by the cpu_id field, otherwise it is the CPU the event
+ * was recorded on.
+ */
+struct trace_event {
+	uint64_t time;		/* nanoseconds */
+	int type;
+	int cpu;
+	unsigned int value;	/* C-state, frequency or IRQ number */
+	char name[NAMELEN+1];	/* IRQ name */
+};
+
+/*
+ * The tracepoints idlestat understands. They are enabled when tracing
+ * and decoded on import from this table only.
+ */
+struct event_desc {
+	const char *system;
+	const char *name;
+	size_t len;		/* length of the name */
+	int type;
+	int optional;		/* not available on all kernels */
+	int (*parse)(const char *p, const char *end, struct trace_event *ev);
+	/* binary fields holding the value and the cpu or the name */
+	const char *fields[2];
+};
+
+extern const struct event_desc event_descs[];
+
+#define for_each_event_desc(desc) \
+	for (desc = event_descs; desc->name; desc++)
+
+extern const struct event_desc *event_desc_lookup(const char *name,
+						  size_t len);
+extern int parse_trace_line(const char *line, size_t len,
+			    struct trace_event *ev);
+
+#endif
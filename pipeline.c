@@ -0,0 +1,406 @@
+/*
+ *  pipeline.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pipeline.h"
+#include "utils.h"
+#include "scan.h"
+#include "spill.h"
+
+/*
+ * The import is split in three stages running concurrently:
+ *
+ *   reader --[blocks]--> parser --[event batches]--> aggregator
+ *
+ * The reader cuts the trace into blocks of complete lines, the parser
+ * decodes them into batches of events and the aggregator, running in
+ * the calling thread, feeds the events to the statistics in the trace
+ * order. Each link is a bounded single-producer/single-consumer ring.
+ * A slot belongs to the producer until it is published and to the
+ * consumer until it is released, so the slot contents are handed over
+ * without copy nor lock.
+ */
+struct spsc_ring {
+	/* producer side */
+	unsigned long head __cacheline_aligned;
+	unsigned long stalls_full;
+	int done;
+	/* consumer side */
+	unsigned long tail __cacheline_aligned;
+	unsigned long stalls_empty;
+	/* read-only */
+	unsigned long size __cacheline_aligned;
+};
+
+struct block {
+	const char *data;
+	size_t len;
+	char *buf;		/* owned buffer, when the trace is streamed */
+	size_t bufsize;
+};
+
+struct batch {
+	int nrevents;
+	struct trace_event events[PIPELINE_BATCH_SIZE];
+};
+
+struct pipeline {
+	struct trace_file *tf;
+	struct spsc_ring blocks_ring;
+	struct spsc_ring batches_ring;
+	struct block blocks[PIPELINE_BLOCKS];
+	struct batch *batches;
+	int nrcpus;
+	int error;		/* the reader could not read the whole trace */
+};
+
+static void ring_init(struct spsc_ring *ring, unsigned long size)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->size = size;
+}
+
+/* producer: wait for a free slot and return its index */
+static unsigned long ring_get_free(struct spsc_ring *ring)
+{
+	unsigned long head = ring->head;
+
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) < ring->size)
+		return head % ring->size;
+
+	ring->stalls_full++;
+	while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >=
+	       ring->size)
+		sched_yield();
+
+	return head % ring->size;
+}
+
+/* producer: hand the slot over to the consumer */
+static void ring_publish(struct spsc_ring *ring)
+{
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/* producer: no more slot will be published */
+static void ring_close(struct spsc_ring *ring)
+{
+	__atomic_store_n(&ring->done, 1, __ATOMIC_RELEASE);
+}
+
+/* consumer: wait for a published slot, return -1 when the ring is closed */
+static long ring_get_full(struct spsc_ring *ring)
+{
+	unsigned long tail = ring->tail;
+
+	if (tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+		return tail % ring->size;
+
+	ring->stalls_empty++;
+	while (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+		/* check head again, it may have been published before done */
+		if (__atomic_load_n(&ring->done, __ATOMIC_ACQUIRE) &&
+		    tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+			return -1;
+		sched_yield();
+	}
+
+	return tail % ring->size;
+}
+
+/* consumer: give the slot back to the producer */
+static void ring_release(struct spsc_ring *ring)
+{
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * The trace is mapped: the blocks point into the mapping and the reader
+ * only faults the pages in, so the parser does not wait for the disk.
+ */
+static void read_mapped(struct pipeline *p)
+{
+	struct trace_file *tf = p->tf;
+	long pagesize = sysconf(_SC_PAGESIZE);
+	struct block *block;
+	const char *eol;
+	volatile char c;
+	size_t len, i;
+
+	while (tf->pos < tf->size) {
+		block = &p->blocks[ring_get_free(&p->blocks_ring)];
+
+		len = MIN(PIPELINE_BLOCK_SIZE, tf->size - tf->pos);
+		if (tf->pos + len < tf->size) {
+			eol = scan_char(tf->map + tf->pos + len,
+					tf->map + tf->size, '\n');
+			len = eol ? eol + 1 - (tf->map + tf->pos) :
+				tf->size - tf->pos;
+		}
+
+		for (i = 0; i < len; i += pagesize)
+			c = tf->map[tf->pos + i];
+		(void)c;
+
+		block->data = tf->map + tf->pos;
+		block->len = len;
+		tf->pos += len;
+		spill_account(len);
+
+		ring_publish(&p->blocks_ring);
+	}
+}
+
+/*
+ * The trace is streamed: each block owns a buffer, the partial line at
+ * the end of a block is moved at the beginning of the next one.
+ */
+static void read_streamed(struct pipeline *p)
+{
+	struct block *block, *prev = NULL;
+	size_t carry = 0, used;
+	const char *eol;
+	ssize_t ret = 0;
+
+	while (1) {
+		block = &p->blocks[ring_get_free(&p->blocks_ring)];
+
+		if (!block->buf) {
+			block->buf = malloc(PIPELINE_BLOCK_SIZE);
+			if (!block->buf) {
+				p->error = -1;
+				break;
+			}
+			block->bufsize = PIPELINE_BLOCK_SIZE;
+		}
+
+		if (carry >= block->bufsize) {
+			char *tmp = realloc(block->buf, carry * 2);
+			if (!tmp) {
+				p->error = -1;
+				break;
+			}
+			block->buf = tmp;
+			block->bufsize = carry * 2;
+		}
+
+		/* the previous block is only read by the parser, and will
+		 * not be reused before this one is published */
+		if (carry)
+			memcpy(block->buf, prev->buf + prev->len, carry);
+		used = carry;
+		carry = 0;
+
+		while (1) {
+			if (used == block->bufsize) {
+				char *tmp = realloc(block->buf,
+						    block->bufsize * 2);
+				if (!tmp) {
+					ret = -1;
+					break;
+				}
+				block->buf = tmp;
+				block->bufsize *= 2;
+			}
+
+			ret = trace_file_read(p->tf, block->buf + used,
+					      block->bufsize - used);
+			if (ret <= 0)
+				break;
+			used += ret;
+
+			/* keep reading until the block holds a full line */
+			eol = memrchr(block->buf, '\n', used);
+			if (eol && used == block->bufsize) {
+				carry = used - (eol + 1 - block->buf);
+				used -= carry;
+				break;
+			}
+		}
+
+		/* the lines read so far are still parsed, the import
+		 * fails once the pipeline is drained */
+		if (ret < 0)
+			p->error = -1;
+
+		if (!used)
+			break;
+
+		block->data = block->buf;
+		block->len = used;
+		prev = block;
+
+		ring_publish(&p->blocks_ring);
+
+		if (ret <= 0 && !carry)
+			break;
+	}
+}
+
+static void *reader(void *arg)
+{
+	struct pipeline *p = arg;
+
+	if (p->tf->map)
+		read_mapped(p);
+	else
+		read_streamed(p);
+
+	ring_close(&p->blocks_ring);
+
+	return NULL;
+}
+
+static void *parser(void *arg)
+{
+	struct pipeline *p = arg;
+	struct batch *batch = NULL;
+	struct block *block;
+	const char *line, *end, *eols[SCAN_LINES_BATCH];
+	struct trace_event ev;
+	size_t i, n = 0;
+	long slot;
+
+	while ((slot = ring_get_full(&p->blocks_ring)) >= 0) {
+		block = &p->blocks[slot];
+		line = block->data;
+		end = block->data + block->len;
+
+		for (i = n = 0; line < end; line = eols[i++] + 1) {
+			if (i == n) {
+				i = 0;
+				n = scan_lines(line, end, eols,
+					       SCAN_LINES_BATCH);
+				if (!n)
+					eols[n++] = end;
+			}
+
+			if (parse_trace_line(line, eols[i] - line, &ev) ||
+			    ev.cpu >= p->nrcpus)
+				continue;
+
+			if (!batch) {
+				batch = &p->batches[
+					ring_get_free(&p->batches_ring)];
+				batch->nrevents = 0;
+			}
+
+			batch->events[batch->nrevents++] = ev;
+			if (batch->nrevents == PIPELINE_BATCH_SIZE) {
+				ring_publish(&p->batches_ring);
+				batch = NULL;
+			}
+		}
+
+		ring_release(&p->blocks_ring);
+	}
+
+	if (batch)
+		ring_publish(&p->batches_ring);
+
+	ring_close(&p->batches_ring);
+
+	return NULL;
+}
+
+/**
+ * import_pipeline - load the events with the reader, the parser and the
+ * aggregator running concurrently
+ * @tf: the trace file, positioned at the first event line
+ * @datas: the per-CPU statistics to fill
+ * @stats: filled with the log duration and the number of events
+ * @stalls: filled with the stall counters of the stages
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int import_pipeline(struct trace_file *tf, struct cpuidle_datas *datas,
+		    struct import_stats *stats, struct pipeline_stalls *stalls)
+{
+	pthread_t reader_thread, parser_thread;
+	struct pipeline *p;
+	struct batch *batch;
+	long slot;
+	int i, failed = 0, ret = -1;
+
+	p = aligned_calloc(1, sizeof(*p));
+	if (!p)
+		return -1;
+
+	p->tf = tf;
+	p->nrcpus = datas->nrcpus;
+	ring_init(&p->blocks_ring, PIPELINE_BLOCKS);
+	ring_init(&p->batches_ring, PIPELINE_BATCHES);
+
+	p->batches = malloc(PIPELINE_BATCHES * sizeof(*p->batches));
+	if (!p->batches)
+		goto out;
+
+	if (pthread_create(&reader_thread, NULL, reader, p))
+		goto out;
+
+	if (pthread_create(&parser_thread, NULL, parser, p)) {
+		/* drain the blocks so the reader can finish */
+		while (ring_get_full(&p->blocks_ring) >= 0)
+			ring_release(&p->blocks_ring);
+		pthread_join(reader_thread, NULL);
+		goto out;
+	}
+
+	while ((slot = ring_get_full(&p->batches_ring)) >= 0) {
+		batch = &p->batches[slot];
+
+		/* on error, the batches are still released so the other
+		 * stages can finish */
+		for (i = 0; i < batch->nrevents && !failed; i++) {
+			import_stats_account(stats, &batch->events[i]);
+			if (store_event(datas, &batch->events[i],
+					stats->count - 1))
+				failed = -1;
+		}
+
+		ring_release(&p->batches_ring);
+	}
+
+	pthread_join(reader_thread, NULL);
+	pthread_join(parser_thread, NULL);
+
+	stalls->reader_full = p->blocks_ring.stalls_full;
+	stalls->parser_empty = p->blocks_ring.stalls_empty;
+	stalls->parser_full = p->batches_ring.stalls_full;
+	stalls->aggregator_empty = p->batches_ring.stalls_empty;
+
+	/* the reader is joined, its error can be read */
+	ret = p->error || failed ? -1 : 0;
+out:
+	for (i = 0; i < PIPELINE_BLOCKS; i++)
+		free(p->blocks[i].buf);
+	free(p->batches);
+	free(p);
+
+	return ret;
+}
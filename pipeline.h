@@ -0,0 +1,48 @@
+/*
+ *  pipeline.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __PIPELINE_H
+#define __PIPELINE_H
+
+#include "import.h"
+
+#define PIPELINE_BLOCKS		8	/* text blocks between reader and parser */
+#define PIPELINE_BLOCK_SIZE	(1 << 20)
+#define PIPELINE_BATCHES	64	/* batches between parser and aggregator */
+#define PIPELINE_BATCH_SIZE	512	/* events per batch */
+
+/*
+ * Number of times each stage had to wait for its neighbour. A stage
+ * waiting for its input is starved by the stage before it, a stage
+ * waiting for room in its output is throttled by the stage after it.
+ */
+struct pipeline_stalls {
+	unsigned long reader_full;	/* block ring full */
+	unsigned long parser_empty;	/* block ring empty */
+	unsigned long parser_full;	/* event ring full */
+	unsigned long aggregator_empty;	/* event ring empty */
+};
+
+extern int import_pipeline(struct trace_file *tf, struct cpuidle_datas *datas,
+			   struct import_stats *stats,
+			   struct pipeline_stalls *stalls);
+
+#endif
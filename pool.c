@@ -0,0 +1,148 @@
+/*
+ *  pool.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+static void *pool_worker(void *arg)
+{
+	struct thread_pool *pool = arg;
+	struct pool_task *task;
+
+	pthread_mutex_lock(&pool->lock);
+
+	while (1) {
+		while (list_empty(&pool->tasks) && !pool->stop)
+			pthread_cond_wait(&pool->work, &pool->lock);
+
+		if (list_empty(&pool->tasks))
+			break;
+
+		task = list_first_entry(&pool->tasks, struct pool_task, list);
+		list_del(&task->list);
+
+		pthread_mutex_unlock(&pool->lock);
+		task->fn(task->arg);
+		free(task);
+		pthread_mutex_lock(&pool->lock);
+
+		if (!--pool->pending)
+			pthread_cond_broadcast(&pool->idle);
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+/**
+ * pool_create - start a pool of worker threads
+ * @nrthreads: number of threads
+ *
+ * Return: the pool (success) or NULL (error)
+ */
+struct thread_pool *pool_create(int nrthreads)
+{
+	struct thread_pool *pool;
+	int i;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pool->threads = calloc(nrthreads, sizeof(*pool->threads));
+	if (!pool->threads) {
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+	INIT_LIST_HEAD(&pool->tasks);
+
+	for (i = 0; i < nrthreads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, pool_worker, pool))
+			break;
+		pool->nrthreads++;
+	}
+
+	if (!pool->nrthreads) {
+		fprintf(stderr, "%s: failed to create threads\n", __func__);
+		pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+int pool_submit(struct thread_pool *pool, pool_fn_t fn, void *arg)
+{
+	struct pool_task *task;
+
+	task = malloc(sizeof(*task));
+	if (!task)
+		return -1;
+
+	task->fn = fn;
+	task->arg = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	list_add_tail(&task->list, &pool->tasks);
+	pool->pending++;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+/* wait for all the submitted tasks to complete */
+void pool_wait(struct thread_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending)
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(struct thread_pool *pool)
+{
+	int i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nrthreads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->idle);
+	free(pool->threads);
+	free(pool);
+}
@@ -0,0 +1,53 @@
+/*
+ *  pool.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __POOL_H
+#define __POOL_H
+
+#include <pthread.h>
+
+#include "list.h"
+
+typedef void (*pool_fn_t)(void *arg);
+
+struct pool_task {
+	struct list_head list;
+	pool_fn_t fn;
+	void *arg;
+};
+
+struct thread_pool {
+	pthread_t *threads;
+	int nrthreads;
+	pthread_mutex_t lock;
+	pthread_cond_t work;	/* a task was queued or the pool is stopping */
+	pthread_cond_t idle;	/* all the queued tasks are done */
+	struct list_head tasks;
+	int pending;		/* queued or running tasks */
+	int stop;
+};
+
+extern struct thread_pool *pool_create(int nrthreads);
+extern int pool_submit(struct thread_pool *pool, pool_fn_t fn, void *arg);
+extern void pool_wait(struct thread_pool *pool);
+extern void pool_destroy(struct thread_pool *pool);
+
+#endif
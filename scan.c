@@ -0,0 +1,132 @@
+/*
+ *  scan.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#include <stdint.h>
+
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+static const char *find_char_scalar(const char *p, const char *end, char c)
+{
+	for (; p < end; p++)
+		if (*p == c)
+			return p;
+
+	return NULL;
+}
+
+static size_t find_lines_scalar(const char *p, const char *end,
+				const char **eols, size_t max)
+{
+	size_t n = 0;
+
+	for (; p < end && n < max; p++)
+		if (*p == '\n')
+			eols[n++] = p;
+
+	return n;
+}
+
+static const struct scan_ops scan_scalar = {
+	.name = "scalar",
+	.find_char = find_char_scalar,
+	.find_lines = find_lines_scalar,
+};
+
+#ifdef SCAN_X86
+/*
+ * The vector kernels compare a whole register with the searched byte
+ * and turn the result into a bit mask, one bit per byte. Only complete
+ * registers are loaded, the tail is handled by the scalar code, so no
+ * byte is read beyond the end of the buffer.
+ */
+#define DEFINE_SCAN_OPS(_name, _target, _vec, _width, _set1, _load,	\
+			_cmpeq, _movemask)				\
+__attribute__((target(_target)))					\
+static const char *find_char_##_name(const char *p, const char *end,	\
+				     char c)				\
+{									\
+	const _vec needle = _set1(c);					\
+	uint32_t mask;							\
+									\
+	for (; end - p >= _width; p += _width) {			\
+		mask = _movemask(_cmpeq(_load((const _vec *)p), needle));\
+		if (mask)						\
+			return p + __builtin_ctz(mask);			\
+	}								\
+									\
+	return find_char_scalar(p, end, c);				\
+}									\
+									\
+__attribute__((target(_target)))					\
+static size_t find_lines_##_name(const char *p, const char *end,	\
+				 const char **eols, size_t max)		\
+{									\
+	const _vec nl = _set1('\n');					\
+	uint32_t mask;							\
+	size_t n = 0;							\
+									\
+	for (; end - p >= _width && n < max; p += _width) {		\
+		mask = _movemask(_cmpeq(_load((const _vec *)p), nl));	\
+		for (; mask && n < max; mask &= mask - 1)		\
+			eols[n++] = p + __builtin_ctz(mask);		\
+		if (mask)						\
+			return n;					\
+	}								\
+									\
+	return n + find_lines_scalar(p, end, eols + n, max - n);	\
+}									\
+									\
+static const struct scan_ops scan_##_name = {				\
+	.name = #_name,							\
+	.find_char = find_char_##_name,					\
+	.find_lines = find_lines_##_name,				\
+}
+
+DEFINE_SCAN_OPS(sse2, "sse2", __m128i, 16, _mm_set1_epi8, _mm_loadu_si128,
+		_mm_cmpeq_epi8, _mm_movemask_epi8);
+DEFINE_SCAN_OPS(avx2, "avx2", __m256i, 32, _mm256_set1_epi8,
+		_mm256_loadu_si256, _mm256_cmpeq_epi8, _mm256_movemask_epi8);
+#endif
+
+const struct scan_ops *scan_ops = &scan_scalar;
+const struct scan_ops *scan_kernels[SCAN_KERNELS_MAX + 1] = { &scan_scalar };
+
+static void __attribute__((constructor)) scan_init(void)
+{
+	int n = 0;
+
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		scan_kernels[n++] = &scan_avx2;
+	if (__builtin_cpu_supports("sse2"))
+		scan_kernels[n++] = &scan_sse2;
+#endif
+	scan_kernels[n++] = &scan_scalar;
+
+	scan_ops = scan_kernels[0];
+}
@@ -0,0 +1,65 @@
+/*
+ *  scan.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __SCAN_H
+#define __SCAN_H
+
+#include <stddef.h>
+
+/* number of line ends looked up by one scan_lines() call */
+#define SCAN_LINES_BATCH 64
+
+/*
+ * Byte scanning kernels used to split the text traces into lines and
+ * the lines into fields. The implementation is picked at startup
+ * depending on the CPU: AVX2, SSE2 or plain C.
+ */
+struct scan_ops {
+	const char *name;
+	const char *(*find_char)(const char *p, const char *end, char c);
+	size_t (*find_lines)(const char *p, const char *end,
+			     const char **eols, size_t max);
+};
+
+extern const struct scan_ops *scan_ops;
+
+/* the kernels the CPU can run, the fastest first, NULL terminated */
+#define SCAN_KERNELS_MAX 3
+extern const struct scan_ops *scan_kernels[SCAN_KERNELS_MAX + 1];
+
+/* return the first occurrence of @c in [p, end) or NULL */
+static inline const char *scan_char(const char *p, const char *end, char c)
+{
+	return scan_ops->find_char(p, end, c);
+}
+
+/*
+ * Store in @eols the position of the next @max line ends at most, in
+ * [p, end). Return the number of line ends found, the next call should
+ * start after the last one.
+ */
+static inline size_t scan_lines(const char *p, const char *end,
+				const char **eols, size_t max)
+{
+	return scan_ops->find_lines(p, end, eols, max);
+}
+
+#endif
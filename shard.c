@@ -0,0 +1,343 @@
+/*
+ *  shard.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shard.h"
+#include "merge.h"
+#include "pool.h"
+#include "trace.h"
+#include "tracefile.h"
+#include "utils.h"
+
+/*
+ * A sharded trace keeps the events of each CPU buffer in its own file.
+ * The kernel does not have to merge the buffers when they are dumped,
+ * and the buffers are dumped in parallel.
+ *
+ * The events of a CPU are not all in its shard though: a CPU may record
+ * the frequency change of another one. On import, the shards are parsed
+ * in parallel into per-CPU event buffers, then the buffers of each CPU
+ * are merged by time, which is a plain copy when a single shard holds
+ * events for the CPU, and replayed.
+ */
+struct shard {
+	const char *path;
+	int cpu;
+	int nrcpus;
+	struct event_buffer *cpus;	/* events by target CPU */
+	struct import_stats stats;
+	int error;
+} __cacheline_aligned;
+
+struct shard_replay {
+	struct cpuidle_datas *datas;
+	struct shard *shards;
+	int nrshards;
+	int cpu;
+	int error;
+} __cacheline_aligned;
+
+/* the events of a CPU held by one shard, as a merge source */
+struct buffer_source {
+	struct event_source src;
+	struct event_buffer *buf;
+	size_t pos;
+};
+
+static void store_shard(void *arg)
+{
+	struct shard *shard = arg;
+	struct trace_file *tf;
+	char *path, *line;
+	size_t len;
+	FILE *f;
+
+	shard->error = -1;
+
+	if (asprintf(&path, TRACE_CPU_TRACE_PATH_FORMAT, shard->cpu) < 0)
+		return;
+
+	tf = trace_file_open(path);
+	free(path);
+	if (!tf)
+		return;
+
+	if (asprintf(&path, SHARD_PATH_FORMAT, shard->path, shard->cpu) < 0) {
+		trace_file_close(tf);
+		return;
+	}
+
+	f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "%s: failed to open '%s': %m\n", __func__, path);
+		free(path);
+		trace_file_close(tf);
+		return;
+	}
+	free(path);
+
+	while ((line = trace_file_getline(tf, &len)))
+		if (store_line(line, len, f))
+			break;
+
+	shard->error = ferror(f) ? -1 : 0;
+	fclose(f);
+	if (trace_file_close(tf))
+		shard->error = -1;
+}
+
+/**
+ * shard_store - dump the buffer of each CPU to its own file, in parallel
+ * @path: the trace file, the shards are named after it
+ * @nrcpus: the number of CPUs
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int shard_store(const char *path, int nrcpus)
+{
+	struct thread_pool *pool;
+	struct shard *shards;
+	int cpu, ret = -1;
+
+	shards = aligned_calloc(nrcpus, sizeof(*shards));
+	pool = pool_create(MIN(nrcpus, sysconf(_SC_NPROCESSORS_ONLN)));
+	if (!shards || !pool)
+		goto out;
+
+	for (cpu = 0; cpu < nrcpus; cpu++) {
+		shards[cpu].path = path;
+		shards[cpu].cpu = cpu;
+		if (pool_submit(pool, store_shard, &shards[cpu]))
+			goto out;
+	}
+
+	pool_wait(pool);
+
+	for (cpu = 0; cpu < nrcpus; cpu++)
+		if (shards[cpu].error)
+			goto out;
+
+	ret = 0;
+out:
+	if (pool) {
+		pool_wait(pool);
+		pool_destroy(pool);
+	}
+	free(shards);
+
+	return ret;
+}
+
+static void parse_shard(void *arg)
+{
+	struct shard *shard = arg;
+	struct trace_file *tf;
+	struct trace_event ev;
+	char *path, *line;
+	size_t len;
+
+	shard->error = -1;
+
+	if (asprintf(&path, SHARD_PATH_FORMAT, shard->path, shard->cpu) < 0)
+		return;
+
+	tf = trace_file_open(path);
+	free(path);
+	if (!tf)
+		return;
+
+	while ((line = trace_file_getline(tf, &len))) {
+		if (parse_trace_line(line, len, &ev) || ev.cpu >= shard->nrcpus)
+			continue;
+
+		if (event_buffer_add(&shard->cpus[ev.cpu], &ev)) {
+			trace_file_close(tf);
+			return;
+		}
+		import_stats_account(&shard->stats, &ev);
+	}
+
+	shard->error = trace_file_close(tf);
+}
+
+static struct trace_event *buffer_source_next(struct event_source *src)
+{
+	struct buffer_source *bs = (struct buffer_source *)src;
+
+	if (bs->pos == bs->buf->nrevents)
+		return NULL;
+
+	return &bs->buf->events[bs->pos++];
+}
+
+static void replay_shards(void *arg)
+{
+	struct shard_replay *task = arg;
+	struct buffer_source *bsources;
+	struct event_source **sources;
+	struct event_buffer *buf;
+	struct event_merge merge;
+	struct trace_event *ev;
+	size_t count = 0;
+	int i, n = 0;
+
+	bsources = calloc(task->nrshards, sizeof(*bsources));
+	sources = calloc(task->nrshards, sizeof(*sources));
+	if (!bsources || !sources) {
+		task->error = -1;
+		goto out;
+	}
+
+	for (i = 0; i < task->nrshards; i++) {
+		buf = &task->shards[i].cpus[task->cpu];
+		if (!buf->nrevents)
+			continue;
+
+		bsources[n].src.next = buffer_source_next;
+		bsources[n].src.id = i;
+		bsources[n].buf = buf;
+		sources[n] = &bsources[n].src;
+		n++;
+	}
+
+	/* most of the time, all the events of the CPU are in its shard */
+	if (n == 1) {
+		buf = bsources[0].buf;
+		for (count = 0; count < buf->nrevents; count++)
+			if (store_event(task->datas, &buf->events[count],
+					count)) {
+				task->error = -1;
+				break;
+			}
+		goto out;
+	}
+
+	if (!n)
+		goto out;
+
+	if (event_merge_init(&merge, sources, n)) {
+		task->error = -1;
+		goto out;
+	}
+
+	while ((ev = event_merge_next(&merge)))
+		if (store_event(task->datas, ev, count++)) {
+			task->error = -1;
+			break;
+		}
+
+	event_merge_release(&merge);
+out:
+	free(sources);
+	free(bsources);
+}
+
+/**
+ * import_shards - load the events of a sharded trace
+ * @path: the trace file, the shards are named after it
+ * @nrshards: the number of shards
+ * @datas: the per-CPU statistics to fill
+ * @jobs: number of threads
+ * @stats: filled with the log duration and the number of events
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int import_shards(const char *path, int nrshards,
+		  struct cpuidle_datas *datas, int jobs,
+		  struct import_stats *stats)
+{
+	struct thread_pool *pool;
+	struct shard *shards;
+	struct shard_replay *tasks;
+	int i, cpu, ret = -1;
+
+	shards = aligned_calloc(nrshards, sizeof(*shards));
+	tasks = aligned_calloc(datas->nrcpus, sizeof(*tasks));
+	pool = pool_create(jobs);
+	if (!shards || !tasks || !pool)
+		goto out;
+
+	for (i = 0; i < nrshards; i++) {
+		shards[i].path = path;
+		shards[i].cpu = i;
+		shards[i].nrcpus = datas->nrcpus;
+		import_stats_init(&shards[i].stats);
+
+		shards[i].cpus = calloc(datas->nrcpus,
+					sizeof(*shards[i].cpus));
+		if (!shards[i].cpus)
+			goto out;
+
+		if (pool_submit(pool, parse_shard, &shards[i]))
+			goto out;
+	}
+
+	pool_wait(pool);
+
+	for (i = 0; i < nrshards; i++) {
+		if (shards[i].error)
+			goto out;
+
+		stats->begin = MIN(stats->begin, shards[i].stats.begin);
+		stats->end = MAX(stats->end, shards[i].stats.end);
+		stats->count += shards[i].stats.count;
+	}
+
+	for (cpu = 0; cpu < datas->nrcpus; cpu++) {
+		tasks[cpu].datas = datas;
+		tasks[cpu].shards = shards;
+		tasks[cpu].nrshards = nrshards;
+		tasks[cpu].cpu = cpu;
+
+		if (pool_submit(pool, replay_shards, &tasks[cpu]))
+			goto out;
+	}
+
+	pool_wait(pool);
+
+	for (cpu = 0; cpu < datas->nrcpus; cpu++)
+		if (tasks[cpu].error)
+			goto out;
+
+	ret = 0;
+out:
+	if (pool) {
+		pool_wait(pool);
+		pool_destroy(pool);
+	}
+
+	for (i = 0; shards && i < nrshards; i++) {
+		for (cpu = 0; shards[i].cpus && cpu < datas->nrcpus; cpu++)
+			free(shards[i].cpus[cpu].events);
+		free(shards[i].cpus);
+	}
+
+	free(shards);
+	free(tasks);
+
+	return ret;
+}
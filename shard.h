@@ -0,0 +1,36 @@
+/*
+ *  shard.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __SHARD_H
+#define __SHARD_H
+
+#include "idlestat.h"
+#include "import.h"
+
+/* the events of each CPU are stored next to the trace, in these files */
+#define SHARD_PATH_FORMAT "%s.cpu%d"
+
+extern int shard_store(const char *path, int nrcpus);
+extern int import_shards(const char *path, int nrshards,
+			 struct cpuidle_datas *datas, int jobs,
+			 struct import_stats *stats);
+
+#endif
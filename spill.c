@@ -0,0 +1,263 @@
+/*
+ *  spill.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "spill.h"
+
+/* the largest mapping tried for the file, halved until it fits */
+#define SPILL_RESERVE_MAX ((size_t)1 << (sizeof(size_t) > 4 ? 40 : 30))
+#define SPILL_RESERVE_MIN (256UL << 20)
+
+struct spill spill = {
+	.fd = -1,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * spill_init - bound the memory of the arenas
+ * @limit: the resident memory not to exceed, in bytes
+ *
+ * The file is created in $TMPDIR, or in /tmp, and removed at once.
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int spill_init(size_t limit)
+{
+	const char *dir = getenv("TMPDIR");
+	char *path;
+	size_t size;
+	void *map = MAP_FAILED;
+
+	if (asprintf(&path, "%s/idlestat-spill-XXXXXX",
+		     dir && *dir ? dir : "/tmp") < 0)
+		return -1;
+
+	spill.fd = mkstemp(path);
+	if (spill.fd < 0) {
+		fprintf(stderr, "%s: failed to create '%s': %m\n", __func__,
+			path);
+		free(path);
+		return -1;
+	}
+
+	unlink(path);
+	free(path);
+
+	/* the addresses are reserved, the disk is allocated as needed */
+	for (size = SPILL_RESERVE_MAX; size >= SPILL_RESERVE_MIN; size /= 2) {
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_NORESERVE, spill.fd, 0);
+		if (map != MAP_FAILED)
+			break;
+	}
+
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: failed to map the spill file: %m\n",
+			__func__);
+		close(spill.fd);
+		spill.fd = -1;
+		return -1;
+	}
+
+	spill.base = map;
+	spill.reserved = size;
+	spill.limit = limit;
+
+	return 0;
+}
+
+/* drop the pages of the file and of the traces from the process */
+static void spill_trim(void)
+{
+	long pagesize = sysconf(_SC_PAGESIZE);
+	int i;
+
+	pthread_mutex_lock(&spill.lock);
+
+	__atomic_store_n(&spill.pending, 0, __ATOMIC_RELAXED);
+
+	/* the mapping is shared, the pages stay in the file */
+	if (spill.used)
+		madvise(spill.base, (spill.used + pagesize - 1) &
+			~(pagesize - 1), MADV_DONTNEED);
+
+	/* the traces are never written, their pages are read again */
+	for (i = 0; i < spill.nrranges; i++)
+		madvise(spill.ranges[i].addr, spill.ranges[i].len,
+			MADV_DONTNEED);
+
+	pthread_mutex_unlock(&spill.lock);
+}
+
+/**
+ * spill_account - count the bytes allocated or walked in the file or
+ * in the traces, the pages are dropped every 1/32 of the limit
+ * @size: the bytes
+ */
+void spill_account(size_t size)
+{
+	if (!spill.limit)
+		return;
+
+	if (__atomic_add_fetch(&spill.pending, size, __ATOMIC_RELAXED) >=
+	    spill.limit / 32)
+		spill_trim();
+}
+
+/* carve a block out of the file, NULL when the disk is full */
+static void *spill_carve(size_t size)
+{
+	void *block = NULL;
+	size_t grow;
+
+	pthread_mutex_lock(&spill.lock);
+
+	if (spill.used + size > spill.reserved)
+		goto out;
+
+	if (spill.used + size > spill.size) {
+		grow = spill.used + size - spill.size;
+		if (grow < SPILL_GROW)
+			grow = SPILL_GROW;
+		if (grow > spill.reserved - spill.size)
+			grow = spill.reserved - spill.size;
+		/* a mapped page without disk space would fault, the space
+		 * is allocated beforehand */
+		if (posix_fallocate(spill.fd, spill.size, grow))
+			goto out;
+		spill.size += grow;
+	}
+
+	block = spill.base + spill.used;
+	spill.used += size;
+out:
+	pthread_mutex_unlock(&spill.lock);
+
+	return block;
+}
+
+/**
+ * spill_block_alloc - allocate a block for an arena
+ * @size: the size of the block, a multiple of 16
+ *
+ * Return: the block, from the heap or from the file, or NULL if out of
+ * memory
+ */
+void *spill_block_alloc(size_t size)
+{
+	static int warned;
+	void *block;
+
+	if (!spill.limit)
+		return malloc(size);
+
+	spill_account(size);
+
+	if (__atomic_add_fetch(&spill.heap, size, __ATOMIC_RELAXED) <=
+	    spill.limit / 2)
+		goto heap;
+	__atomic_sub_fetch(&spill.heap, size, __ATOMIC_RELAXED);
+
+	block = spill_carve(size);
+	if (block)
+		return block;
+
+	if (!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED))
+		fprintf(stderr, "warning: the spill file is full, the memory "
+			"limit is exceeded\n");
+
+	__atomic_add_fetch(&spill.heap, size, __ATOMIC_RELAXED);
+heap:
+	block = malloc(size);
+	if (!block)
+		__atomic_sub_fetch(&spill.heap, size, __ATOMIC_RELAXED);
+
+	return block;
+}
+
+/**
+ * spill_block_free - free a block of an arena
+ * @block: the block
+ * @size: its size
+ *
+ * The space of the file is not reused.
+ */
+void spill_block_free(void *block, size_t size)
+{
+	if (spill_contains(block))
+		return;
+
+	free(block);
+
+	if (spill.limit)
+		__atomic_sub_fetch(&spill.heap, size, __ATOMIC_RELAXED);
+}
+
+/**
+ * spill_watch - drop the pages of a read-only mapping with the ones of
+ * the file
+ * @addr: the mapping, it must be unwatched before it is unmapped
+ * @len: its length
+ */
+void spill_watch(void *addr, size_t len)
+{
+	struct spill_range *ranges;
+
+	if (!spill.limit)
+		return;
+
+	pthread_mutex_lock(&spill.lock);
+
+	ranges = realloc(spill.ranges,
+			 (spill.nrranges + 1) * sizeof(*ranges));
+	if (ranges) {
+		ranges[spill.nrranges].addr = addr;
+		ranges[spill.nrranges++].len = len;
+		spill.ranges = ranges;
+	}
+
+	pthread_mutex_unlock(&spill.lock);
+}
+
+void spill_unwatch(void *addr)
+{
+	int i;
+
+	if (!spill.limit)
+		return;
+
+	pthread_mutex_lock(&spill.lock);
+
+	for (i = 0; i < spill.nrranges; i++)
+		if (spill.ranges[i].addr == addr) {
+			spill.ranges[i] = spill.ranges[--spill.nrranges];
+			break;
+		}
+
+	pthread_mutex_unlock(&spill.lock);
+}
@@ -0,0 +1,84 @@
+/*
+ *  spill.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __SPILL_H
+#define __SPILL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * With --memory-limit, the blocks of the arenas are taken from the heap
+ * until they hold half of the limit, then from a temporary file mapped
+ * shared. The pages of the file are dropped from the process each time
+ * a few blocks were allocated or walked: the kernel writes them back and
+ * reads them again when the intervals are walked. The read-only mappings
+ * of the traces are dropped at the same time, so the resident memory
+ * does not grow with the trace.
+ */
+#define SPILL_GROW (64UL << 20)
+/* the traces read line by line are accounted by steps of 1MB */
+#define SPILL_STEP_SHIFT 20
+
+struct spill_range {
+	void *addr;
+	size_t len;
+};
+
+struct spill {
+	size_t limit;		/* 0 without a limit */
+	size_t heap;		/* bytes of the blocks taken from the heap */
+	size_t pending;		/* bytes allocated or walked since the
+				 * pages were last dropped */
+	char *base;		/* the file, mapped at once */
+	size_t reserved;	/* size of the mapping */
+	size_t used;		/* bytes handed out */
+	size_t size;		/* bytes allocated on the disk */
+	int fd;
+	pthread_mutex_t lock;	/* the file and the ranges */
+	struct spill_range *ranges;	/* the mapped traces */
+	int nrranges;
+};
+
+extern struct spill spill;
+
+extern int spill_init(size_t limit);
+extern void *spill_block_alloc(size_t size);
+extern void spill_block_free(void *block, size_t size);
+extern void spill_account(size_t size);
+extern void spill_watch(void *addr, size_t len);
+extern void spill_unwatch(void *addr);
+
+static inline bool spill_contains(const void *p)
+{
+	return (const char *)p >= spill.base &&
+		(const char *)p < spill.base + spill.reserved;
+}
+
+/* account the intervals walked, when they are in the file */
+static inline void spill_touch(const void *p, size_t size)
+{
+	if (spill.limit && spill_contains(p))
+		spill_account(size);
+}
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ *  summary.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#include "summary.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SUMMARY_X86
+#endif
+
+static void summary_add_scalar(struct interval_summary *s,
+			       const uint64_t *begin, const uint64_t *end,
+			       size_t n, int64_t low, int64_t high)
+{
+	int64_t d;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		d = end[i] - begin[i];
+		if ((uint64_t)d < s->min)
+			s->min = d;
+		if ((uint64_t)d > s->max)
+			s->max = d;
+		s->sum += d;
+		s->below += d < low;
+		s->above += d >= low && d >= high;
+	}
+
+	s->count += n;
+}
+
+static const struct summary_ops summary_scalar = {
+	.name = "scalar",
+	.add = summary_add_scalar,
+};
+
+#ifdef SUMMARY_X86
+/*
+ * The lanes keep their own minimum, maximum, sum and counts, the
+ * comparison masks are all ones, subtracting them counts. The lanes are
+ * folded once at the end and the tail is handled by the scalar code.
+ */
+#define DEFINE_SUMMARY_OPS(_name, _target, _vec, _width, _set1, _load,	\
+			   _store, _add, _sub, _cmpgt, _or, _blendv)		\
+__attribute__((target(_target)))					\
+static void summary_add_##_name(struct interval_summary *s,		\
+				const uint64_t *begin,			\
+				const uint64_t *end, size_t n,		\
+				int64_t low, int64_t high)		\
+{									\
+	const _vec vlow = _set1(low), vhigh = _set1(high);		\
+	_vec vmin = _set1(INT64_MAX), vmax = _set1(0), vsum = _set1(0);\
+	_vec vbelow = _set1(0), vabove = _set1(0), d, lt;		\
+	int64_t lanes[_width / 8];					\
+	size_t i, l;							\
+									\
+	for (i = 0; i + _width / 8 <= n; i += _width / 8) {		\
+		d = _sub(_load((const _vec *)&end[i]),			\
+			 _load((const _vec *)&begin[i]));		\
+		vmin = _blendv(vmin, d, _cmpgt(vmin, d));		\
+		vmax = _blendv(vmax, d, _cmpgt(d, vmax));		\
+		vsum = _add(vsum, d);					\
+		lt = _cmpgt(vlow, d);					\
+		vbelow = _sub(vbelow, lt);				\
+		/* not below low nor high */				\
+		vabove = _add(vabove, _add(_set1(1),			\
+			_or(lt, _cmpgt(vhigh, d))));			\
+	}								\
+									\
+	_store((_vec *)lanes, vmin);					\
+	for (l = 0; l < _width / 8; l++)				\
+		if (i && (uint64_t)lanes[l] < s->min)			\
+			s->min = lanes[l];				\
+	_store((_vec *)lanes, vmax);					\
+	for (l = 0; l < _width / 8; l++)				\
+		if ((uint64_t)lanes[l] > s->max)			\
+			s->max = lanes[l];				\
+	_store((_vec *)lanes, vsum);					\
+	for (l = 0; l < _width / 8; l++)				\
+		s->sum += lanes[l];					\
+	_store((_vec *)lanes, vbelow);					\
+	for (l = 0; l < _width / 8; l++)				\
+		s->below += lanes[l];					\
+	_store((_vec *)lanes, vabove);					\
+	for (l = 0; l < _width / 8; l++)				\
+		s->above += lanes[l];					\
+									\
+	/* the scalar code counts the tail, the lanes have no count */	\
+	s->count += i;							\
+	summary_add_scalar(s, begin + i, end + i, n - i, low, high);	\
+}									\
+									\
+static const struct summary_ops summary_##_name = {			\
+	.name = #_name,							\
+	.add = summary_add_##_name,					\
+}
+
+DEFINE_SUMMARY_OPS(sse42, "sse4.2", __m128i, 16, _mm_set1_epi64x,
+		   _mm_loadu_si128, _mm_storeu_si128, _mm_add_epi64,
+		   _mm_sub_epi64, _mm_cmpgt_epi64, _mm_or_si128,
+		   _mm_blendv_epi8);
+DEFINE_SUMMARY_OPS(avx2, "avx2", __m256i, 32, _mm256_set1_epi64x,
+		   _mm256_loadu_si256, _mm256_storeu_si256, _mm256_add_epi64,
+		   _mm256_sub_epi64, _mm256_cmpgt_epi64, _mm256_or_si256,
+		   _mm256_blendv_epi8);
+#endif
+
+const struct summary_ops *summary_ops = &summary_scalar;
+
+static void __attribute__((constructor)) summary_init(void)
+{
+#ifdef SUMMARY_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		summary_ops = &summary_avx2;
+	else if (__builtin_cpu_supports("sse4.2"))
+		summary_ops = &summary_sse42;
+#endif
+}
@@ -0,0 +1,73 @@
+/*
+ *  summary.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __SUMMARY_H
+#define __SUMMARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The statistics of a column of intervals: the durations are end - begin
+ * and are compared as signed 64-bit integers, they never reach 2^63 ns.
+ */
+struct interval_summary {
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+	unsigned long count;
+	unsigned long below;	/* durations < low */
+	unsigned long above;	/* durations >= low and >= high */
+};
+
+/*
+ * Vector kernels summarizing the begin and end columns of the intervals.
+ * The implementation is picked at startup depending on the CPU: AVX2,
+ * SSE4.2 or plain C.
+ */
+struct summary_ops {
+	const char *name;
+	void (*add)(struct interval_summary *s, const uint64_t *begin,
+		    const uint64_t *end, size_t n, int64_t low, int64_t high);
+};
+
+extern const struct summary_ops *summary_ops;
+
+static inline void interval_summary_init(struct interval_summary *s)
+{
+	s->min = UINT64_MAX;
+	s->max = 0;
+	s->sum = 0;
+	s->count = 0;
+	s->below = 0;
+	s->above = 0;
+}
+
+/* add the @n intervals of the columns to @s */
+static inline void interval_summary_add(struct interval_summary *s,
+					const uint64_t *begin,
+					const uint64_t *end, size_t n,
+					int64_t low, int64_t high)
+{
+	summary_ops->add(s, begin, end, n, low, high);
+}
+
+#endif
@@ -0,0 +1,159 @@
+#!/bin/sh
+#
+# check.sh
+#
+# Copyright (C) 2014, Linaro Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+# Regression tests of the import, run by 'make check':
+#
+#   tests/check.sh <idlestat binary>
+#
+# The C-state names and the target residencies are read from the host,
+# so the reports are only compared with each other, never with a saved
+# output.
+
+IDLESTAT=${1:-./idlestat}
+TRACES=$(dirname "$0")/traces
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+failures=0
+
+fail()
+{
+	echo "FAIL: $*"
+	failures=$((failures + 1))
+}
+
+# import <name> <trace> [options], the report is left in $TMP/<name>
+import()
+{
+	name=$1
+	trace=$2
+	shift 2
+
+	import_cached "$name" "$trace" --no-cache "$@"
+}
+
+# import_cached <name> <trace> [options], like import() with the cache
+import_cached()
+{
+	name=$1
+	trace=$2
+	shift 2
+
+	"$IDLESTAT" --import -f "$trace" -o "$TMP/$name" \
+		"$@" > "$TMP/$name.log" 2>&1
+	status=$?
+	if [ $status -ne 0 ]; then
+		fail "$name: idlestat exited with $status"
+		cat "$TMP/$name.log"
+		return 1
+	fi
+}
+
+# the report lists the CPU @2 of @1
+has_cpu()
+{
+	grep -q "^| *cpu$2 " "$TMP/$1"
+}
+
+# A topology with more CPUs than the trace, the one of the trace or the
+# one of this host for a trace.dat without topology: the CPUs missing
+# from the trace are not reported and do not take part in the cores and
+# the clusters.
+for opt in "" "--at-least" "--online" "-c -C" "-j 2"; do
+	name="fewer-cpus$(echo "$opt" | tr -d ' ')"
+	import "$name" "$TRACES/fewer-cpus.trace" $opt || continue
+	has_cpu "$name" 1 || fail "$name: cpu1 is missing"
+	has_cpu "$name" 2 && fail "$name: cpu2 is not in the trace"
+done
+
+import fewer-cpus-dat "$TRACES/fewer-cpus.dat" &&
+	! has_cpu fewer-cpus-dat 0 && fail "fewer-cpus-dat: cpu0 is missing"
+
+# The C-states of the cores and the clusters are the same counted while
+# the trace is parsed or intersected afterwards, with CPUs still idle at
+# the end of the trace and an event lost.
+for opt in "" "--at-least"; do
+	test="idle-end$(echo "$opt" | tr -d ' ')"
+	import "$test" "$TRACES/idle-end.trace" -c $opt &&
+	import "$test-online" "$TRACES/idle-end.trace" -c --online $opt &&
+	! cmp -s "$TMP/$test" "$TMP/$test-online" &&
+		fail "$test: --online reports other C-states"
+done
+
+# --no-cache leaves nothing next to the trace, the index of a windowed
+# import included.
+cp "$TRACES/fewer-cpus.trace" "$TMP/window.trace"
+import window "$TMP/window.trace" --from 100.2 --to 100.6 &&
+	[ -e "$TMP/window.trace.idlestat-index" ] &&
+	fail "window: the index is saved with --no-cache"
+
+# The second import of a trace is served from its cache, and a cache
+# which is corrupted or older than the trace is ignored: the reports are
+# always the ones of the trace parsed again.
+for file in fewer-cpus.trace idle-end.trace fewer-cpus.dat; do
+	test="cache-$file"
+	cp "$TRACES/$file" "$TMP/$file"
+	import "$test" "$TMP/$file" -c -p -w || continue
+
+	import_cached "$test-store" "$TMP/$file" -c -p -w &&
+	import_cached "$test-load" "$TMP/$file" -c -p -w || continue
+	[ -e "$TMP/$file.idlestat-cache" ] ||
+		fail "$test: the cache is not saved"
+	for report in store load; do
+		cmp -s "$TMP/$test" "$TMP/$test-$report" ||
+			fail "$test-$report: the report differs"
+	done
+
+	# truncated
+	head -c 200 "$TMP/$file.idlestat-cache" > "$TMP/$file.tmp"
+	mv "$TMP/$file.tmp" "$TMP/$file.idlestat-cache"
+	import_cached "$test-truncated" "$TMP/$file" -c -p -w &&
+		! cmp -s "$TMP/$test" "$TMP/$test-truncated" &&
+		fail "$test-truncated: the report differs"
+
+	# overwritten header
+	printf 'garbage' | dd of="$TMP/$file.idlestat-cache" conv=notrunc \
+		2> /dev/null
+	import_cached "$test-garbage" "$TMP/$file" -c -p -w &&
+		! cmp -s "$TMP/$test" "$TMP/$test-garbage" &&
+		fail "$test-garbage: the report differs"
+done
+
+# appended to once cached
+for file in fewer-cpus.trace idle-end.trace; do
+	test="cache-append-$file"
+	cp "$TRACES/$file" "$TMP/$file"
+	import_cached "$test-store" "$TMP/$file" -c -p -w || continue
+	cat >> "$TMP/$file" <<EOF
+          <idle>-0     [000] d..2   200.000000: cpu_idle: state=0 cpu_id=0
+          <idle>-0     [000] d..2   200.001000: cpu_idle: state=4294967295 cpu_id=0
+EOF
+	import "$test" "$TMP/$file" -c -p -w &&
+	import_cached "$test-load" "$TMP/$file" -c -p -w &&
+		! cmp -s "$TMP/$test" "$TMP/$test-load" &&
+		fail "$test-load: the report differs"
+done
+
+if [ $failures -ne 0 ]; then
+	echo "$failures test(s) failed"
+	exit 1
+fi
+
+echo "all tests passed"
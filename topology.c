@@ -36,203 +36,355 @@
 #include <sys/stat.h>
 #include <assert.h>
 
-#include "list.h"
 #include "utils.h"
 #include "topology.h"
 #include "idlestat.h"
+#include "cluster.h"
+#include "interval.h"
+#include "pool.h"
 
 struct cpu_topology g_cpu_topo_list;
 
 struct topology_info {
-	int physical_id;
-	int core_id;
+	int ids[TOPO_LEVELS];
 	int cpu_id;
 };
 
-struct list_info {
-	struct list_head hlist;
-	int id;
+static const char * const topo_level_names[TOPO_LEVELS] = {
+	[TOPO_CORE]	= "core",
+	[TOPO_CLUSTER]	= "cluster",
+	[TOPO_LLC]	= "llc",
+	[TOPO_NODE]	= "node",
+	[TOPO_DIE]	= "die",
+	[TOPO_PACKAGE]	= "package",
 };
 
-struct list_head *check_exist_from_head(struct list_head *head, int id)
+/**
+ * topo_level_parse - find a level of the topology from its name
+ * @name: "cluster", "llc", "node", "die" or "package"
+ *
+ * Return: the level, -1 if the name is unknown. The cores are always
+ * reported, they are not a level of the clusters.
+ */
+int topo_level_parse(const char *name)
 {
-	struct list_head *tmp;
+	int level;
 
-	list_for_each(tmp, head) {
-		if (id == ((struct list_info *)tmp)->id)
-			return tmp;
-	}
+	for (level = TOPO_CLUSTER; level < TOPO_LEVELS; level++)
+		if (!strcmp(name, topo_level_names[level]))
+			return level;
 
-	return NULL;
+	return -1;
 }
 
-struct list_head *check_pos_from_head(struct list_head *head, int id)
+/* the highest level where the CPUs differ, -1 for the same ids */
+static int topo_info_diff(const struct topology_info *a,
+			  const struct topology_info *b)
 {
-	struct list_head *tmp;
+	int level;
 
-	list_for_each(tmp, head) {
-		if (id < ((struct list_info *)tmp)->id)
-			break;
-	}
+	for (level = TOPO_LEVELS - 1; level >= 0; level--)
+		if (a->ids[level] != b->ids[level])
+			return level;
+
+	return -1;
+}
+
+static int topo_info_cmp(const void *a, const void *b)
+{
+	const struct topology_info *ia = a, *ib = b;
+	int level = topo_info_diff(ia, ib);
+
+	if (level >= 0)
+		return ia->ids[level] < ib->ids[level] ? -1 : 1;
+	if (ia->cpu_id != ib->cpu_id)
+		return ia->cpu_id < ib->cpu_id ? -1 : 1;
 
-	return tmp->prev;
+	return 0;
 }
 
+/*
+ * Record a CPU, the arrays are built once all of them are known. A CPU
+ * already recorded keeps its place.
+ */
 int add_topo_info(struct cpu_topology *topo_list, struct topology_info *info)
 {
-	struct cpu_physical *s_phy;
-	struct cpu_core     *s_core;
-	struct cpu_cpu      *s_cpu = NULL;
-	struct list_head    *ptr;
-
-	/* add cpu physical info */
-	ptr = check_exist_from_head(&topo_list->physical_head,
-					info->physical_id);
-	if (!ptr) {
-		s_phy = calloc(sizeof(struct cpu_physical), 1);
-		if (!s_phy)
-			return -1;
+	struct topology_info *infos;
+	int *index, size, i;
 
-		s_phy->core_num = 0;
-		s_phy->physical_id = info->physical_id;
-		INIT_LIST_HEAD(&s_phy->core_head);
-
-		ptr = check_pos_from_head(&topo_list->physical_head,
-						s_phy->physical_id);
-		list_add(&s_phy->list_physical, ptr);
-		topo_list->physical_num++;
-	} else {
-		s_phy = list_entry(ptr, struct cpu_physical,
-						list_physical);
-	}
+	if (info->cpu_id < 0)
+		return -1;
 
-	/* add cpu core info */
-	ptr = check_exist_from_head(&s_phy->core_head, info->core_id);
-	if (!ptr) {
-		s_core = calloc(sizeof(struct cpu_core), 1);
-		if (!s_core)
+	if (info->cpu_id >= topo_list->cpu_index_size) {
+		size = MAX(info->cpu_id + 1, 2 * topo_list->cpu_index_size);
+		index = realloc(topo_list->cpu_index, size * sizeof(*index));
+		if (!index)
 			return -1;
 
-		s_core->cpu_num = 0;
-		s_core->is_ht = false;
-		s_core->core_id = info->core_id;
-		INIT_LIST_HEAD(&s_core->cpu_head);
+		for (i = topo_list->cpu_index_size; i < size; i++)
+			index[i] = -1;
 
-		ptr = check_pos_from_head(&s_phy->core_head,
-						s_core->core_id);
-		list_add(&s_core->list_core, ptr);
-		s_phy->core_num++;
-
-	} else {
-		s_core = list_entry(ptr, struct cpu_core, list_core);
+		topo_list->cpu_index = index;
+		topo_list->cpu_index_size = size;
 	}
 
-	/* add cpu info */
-	ptr = check_exist_from_head(&s_core->cpu_head, info->cpu_id);
-	if (!ptr) {
-		s_cpu = calloc(sizeof(struct cpu_cpu), 1);
-		if (!s_cpu)
-			return -1;
-
-		s_cpu->cpu_id = info->cpu_id;
+	if (topo_list->cpu_index[info->cpu_id] >= 0)
+		return 0;
 
-		ptr = check_pos_from_head(&s_core->cpu_head, s_cpu->cpu_id);
-		list_add(&s_cpu->list_cpu, ptr);
-		s_core->cpu_num++;
-		if (s_core->cpu_num > 1)
-			s_core->is_ht = true;
+	/* the array doubles when its size reaches a power of two */
+	size = topo_list->info_num;
+	if (!(size & (size - 1))) {
+		infos = realloc(topo_list->infos,
+				MAX(2 * size, 16) * sizeof(*infos));
+		if (!infos)
+			return -1;
+		topo_list->infos = infos;
 	}
 
+	/* the index is used while reading to find the recorded CPUs, it
+	 * points to the infos until the arrays are built */
+	infos = topo_list->infos;
+	topo_list->cpu_index[info->cpu_id] = topo_list->info_num;
+	infos[topo_list->info_num++] = *info;
+
 	return 0;
 }
 
-void free_cpu_cpu_list(struct list_head *head)
+static void free_cpu_arrays(struct cpu_topology *topo_list)
 {
-	struct cpu_cpu *lcpu, *n;
+	int level;
 
-	list_for_each_entry_safe(lcpu, n, head, list_cpu) {
-		list_del(&lcpu->list_cpu);
-		free(lcpu);
+	for (level = TOPO_CLUSTER; level < TOPO_LEVELS; level++) {
+		free(topo_list->groups[level]);
+		topo_list->groups[level] = NULL;
+		topo_list->group_num[level] = 0;
 	}
+
+	free(topo_list->cores);
+	free(topo_list->cpus);
+	topo_list->cores = NULL;
+	topo_list->cpus = NULL;
+	topo_list->core_num = 0;
+	topo_list->cpu_num = 0;
 }
 
-void free_cpu_core_list(struct list_head *head)
+/* start a group with the CPU @i, in the group @parent of the level above */
+static struct cpu_group *new_cpu_group(struct cpu_topology *topo_list,
+				       int level, struct cpu_group *parent,
+				       int i)
 {
-	struct cpu_core *lcore, *n;
-
-	list_for_each_entry_safe(lcore, n, head, list_core) {
-		free_cpu_cpu_list(&lcore->cpu_head);
-		list_del(&lcore->list_core);
-		free(lcore);
-	}
+	struct cpu_group *g;
+
+	g = &topo_list->groups[level][topo_list->group_num[level]];
+	g->level = level;
+	g->id = topo_list->group_num[level];
+	g->children = level > TOPO_CLUSTER ?
+		&topo_list->groups[level - 1][topo_list->group_num[level - 1]] :
+		NULL;
+	g->cores = &topo_list->cores[topo_list->core_num];
+	g->cpus = &topo_list->cpus[i];
+
+	if (parent)
+		parent->child_num++;
+	topo_list->group_num[level]++;
+
+	return g;
 }
 
-void free_cpu_topology(struct list_head *head)
+/*
+ * Build the arrays from the CPUs recorded so far: sort them by their ids
+ * from the package down to the core, then cut the ranges of the groups
+ * of each level. A CPU whose ids differ from the ones of the previous
+ * CPU at some level starts a new group at that level and at all the
+ * levels below.
+ */
+static int build_cpu_arrays(struct cpu_topology *topo_list)
 {
-	struct cpu_physical *lphysical, *n;
+	struct topology_info *infos, *info;
+	struct cpu_group    *g[TOPO_LEVELS + 1] = { NULL };
+	struct cpu_core     *s_core = NULL;
+	struct cpu_cpu      *s_cpu;
+	int i, level, diff, n = topo_list->info_num;
+
+	free_cpu_arrays(topo_list);
+
+	if (!n)
+		return 0;
+
+	infos = malloc(n * sizeof(*infos));
+	if (!infos)
+		return -1;
 
-	list_for_each_entry_safe(lphysical, n, head, list_physical) {
-		free_cpu_core_list(&lphysical->core_head);
-		list_del(&lphysical->list_physical);
-		free(lphysical);
+	memcpy(infos, topo_list->infos, n * sizeof(*infos));
+	qsort(infos, n, sizeof(*infos), topo_info_cmp);
+
+	for (level = TOPO_CLUSTER; level < TOPO_LEVELS; level++) {
+		topo_list->groups[level] = calloc(n, sizeof(struct cpu_group));
+		if (!topo_list->groups[level])
+			goto fail;
 	}
-}
 
-int output_topo_info(struct cpu_topology *topo_list)
-{
-	struct cpu_physical *s_phy;
-	struct cpu_core     *s_core;
-	struct cpu_cpu      *s_cpu;
+	topo_list->cores = calloc(n, sizeof(*topo_list->cores));
+	topo_list->cpus = calloc(n, sizeof(*topo_list->cpus));
+	if (!topo_list->cores || !topo_list->cpus)
+		goto fail;
+
+	for (i = 0; i < n; i++) {
+		info = &infos[i];
+		diff = i ? topo_info_diff(info, &infos[i - 1]) : TOPO_LEVELS;
+
+		for (level = MIN(diff, TOPO_PACKAGE); level > TOPO_CORE;
+		     level--) {
+			g[level] = new_cpu_group(topo_list, level,
+						 g[level + 1], i);
+			/* the packages keep their ids, they name the
+			 * clusters of the report */
+			if (level == TOPO_PACKAGE)
+				g[level]->id = info->ids[TOPO_PACKAGE];
+		}
 
-	list_for_each_entry(s_phy, &topo_list->physical_head, list_physical) {
-		printf("cluster%c:\n", s_phy->physical_id + 'A');
-		list_for_each_entry(s_core, &s_phy->core_head, list_core) {
-			printf("\tcore%d\n", s_core->core_id);
-			list_for_each_entry(s_cpu, &s_core->cpu_head, list_cpu)
-				printf("\t\tcpu%d\n", s_cpu->cpu_id);
+		if (diff >= TOPO_CORE) {
+			s_core = &topo_list->cores[topo_list->core_num++];
+			s_core->core_id = info->ids[TOPO_CORE];
+			s_core->cluster = g[TOPO_CLUSTER];
+			s_core->cpus = &topo_list->cpus[i];
+			for (level = TOPO_CLUSTER; level < TOPO_LEVELS; level++)
+				g[level]->core_num++;
 		}
+
+		s_cpu = &topo_list->cpus[i];
+		s_cpu->cpu_id = info->cpu_id;
+		memcpy(s_cpu->ids, info->ids, sizeof(s_cpu->ids));
+		s_cpu->core = s_core;
+		s_core->cpu_num++;
+		s_core->is_ht = s_core->cpu_num > 1;
+		for (level = TOPO_CLUSTER; level < TOPO_LEVELS; level++)
+			g[level]->cpu_num++;
+
+		topo_list->cpu_index[info->cpu_id] = i;
 	}
 
+	topo_list->cpu_num = n;
+
+	free(infos);
+
 	return 0;
+fail:
+	free_cpu_arrays(topo_list);
+	free(infos);
+
+	return -1;
 }
 
+void free_cpu_topology(struct cpu_topology *topo_list)
+{
+	free_cpu_arrays(topo_list);
+	free(topo_list->cpu_index);
+	free(topo_list->infos);
+	topo_list->cpu_index = NULL;
+	topo_list->cpu_index_size = 0;
+	topo_list->infos = NULL;
+	topo_list->info_num = 0;
+}
+
+/*
+ * The levels between the core and the package follow the CPU id as
+ * "name=id" fields, the ones with the id 0 are omitted. Older versions
+ * of idlestat ignore them.
+ */
 int outfile_topo_info(FILE *f, struct cpu_topology *topo_list)
 {
-	struct cpu_physical *s_phy;
+	struct cpu_group    *s_phy;
 	struct cpu_core     *s_core;
 	struct cpu_cpu      *s_cpu;
+	int level;
 
-	list_for_each_entry(s_phy, &topo_list->physical_head, list_physical) {
-		fprintf(f, "cluster%c:\n", s_phy->physical_id + 'A');
-		list_for_each_entry(s_core, &s_phy->core_head, list_core) {
+	topo_for_each_group(topo_list, TOPO_PACKAGE, s_phy) {
+		fprintf(f, "cluster%c:\n", s_phy->id + 'A');
+		group_for_each_core(s_phy, s_core) {
 			fprintf(f, "\tcore%d\n", s_core->core_id);
-			list_for_each_entry(s_cpu, &s_core->cpu_head, list_cpu)
-				fprintf(f, "\t\tcpu%d\n", s_cpu->cpu_id);
+			core_for_each_cpu(s_core, s_cpu) {
+				fprintf(f, "\t\tcpu%d", s_cpu->cpu_id);
+				for (level = TOPO_CLUSTER; level < TOPO_PACKAGE;
+				     level++)
+					if (s_cpu->ids[level])
+						fprintf(f, " %s=%d",
+							topo_level_names[level],
+							s_cpu->ids[level]);
+				fprintf(f, "\n");
+			}
 		}
 	}
 
 	return 0;
 }
 
-struct cpu_cpu *find_cpu_point(struct cpu_topology *topo_list, int cpuid)
+int output_topo_info(struct cpu_topology *topo_list)
 {
-	struct cpu_physical *s_phy;
-	struct cpu_core     *s_core;
-	struct cpu_cpu      *s_cpu;
+	return outfile_topo_info(stdout, topo_list);
+}
 
-	list_for_each_entry(s_phy, &topo_list->physical_head, list_physical)
-		list_for_each_entry(s_core, &s_phy->core_head, list_core)
-			list_for_each_entry(s_cpu, &s_core->cpu_head, list_cpu)
-				if (s_cpu->cpu_id == cpuid)
-					return s_cpu;
+struct cpu_cpu *find_cpu_point(struct cpu_topology *topo_list, int cpuid)
+{
+	if (cpuid < 0 || cpuid >= topo_list->cpu_index_size ||
+	    topo_list->cpu_index[cpuid] < 0 ||
+	    topo_list->cpu_index[cpuid] >= topo_list->cpu_num)
+		return NULL;
 
-	return NULL;
+	return &topo_list->cpus[topo_list->cpu_index[cpuid]];
 }
 
 static inline int read_topology_cb(char *path, struct topology_info *info)
 {
-	file_read_value(path, "core_id", "%d", &info->core_id);
-	file_read_value(path, "physical_package_id", "%d", &info->physical_id);
+	file_read_value(path, "core_id", "%d", &info->ids[TOPO_CORE]);
+	file_read_value(path, "cluster_id", "%d", &info->ids[TOPO_CLUSTER]);
+	file_read_value(path, "die_id", "%d", &info->ids[TOPO_DIE]);
+	file_read_value(path, "physical_package_id", "%d",
+			&info->ids[TOPO_PACKAGE]);
+
+	return 0;
+}
+
+/*
+ * The last level cache is named after the first CPU sharing it, the
+ * node is the one the CPU directory links to.
+ */
+static int read_domains_cb(char *path, struct topology_info *info)
+{
+	struct dirent *direntp;
+	int index, level, max = -1, first;
+	char *cache;
+	DIR *dir;
+
+	for (index = 0; ; index++) {
+		if (asprintf(&cache, "%s/cache/index%d", path, index) < 0)
+			return -1;
+
+		if (file_read_value(cache, "level", "%d", &level)) {
+			free(cache);
+			break;
+		}
+
+		/* "0-7,64-71" */
+		if (level > max &&
+		    !file_read_value(cache, "shared_cpu_list", "%d", &first)) {
+			info->ids[TOPO_LLC] = first;
+			max = level;
+		}
+
+		free(cache);
+	}
+
+	dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	while ((direntp = readdir(dir)))
+		if (sscanf(direntp->d_name, "node%d",
+			   &info->ids[TOPO_NODE]) == 1)
+			break;
+
+	closedir(dir);
 
 	return 0;
 }
@@ -312,7 +464,13 @@ static int topo_folder_scan(char *path, folder_filter_t filter)
 				continue;
 			closedir(dir_topology);
 
+			memset(&cpu_info, 0, sizeof(cpu_info));
 			read_topology_cb(newpath, &cpu_info);
+
+			/* the directory of the CPU */
+			newpath[strlen(newpath) - strlen("/topology")] = '\0';
+			read_domains_cb(newpath, &cpu_info);
+
 			assert(sscanf(direntp->d_name, "cpu%d",
 				      &cpu_info.cpu_id) == 1);
 			add_topo_info(&g_cpu_topo_list, &cpu_info);
@@ -333,8 +491,7 @@ out_free_basedir:
 
 int init_cpu_topo_info(void)
 {
-	INIT_LIST_HEAD(&g_cpu_topo_list.physical_head);
-	g_cpu_topo_list.physical_num = 0;
+	memset(&g_cpu_topo_list, 0, sizeof(g_cpu_topo_list));
 
 	return 0;
 }
@@ -343,66 +500,122 @@ int read_sysfs_cpu_topo(void)
 {
 	topo_folder_scan("/sys/devices/system/cpu", cpu_filter_cb);
 
-	return 0;
+	return build_cpu_arrays(&g_cpu_topo_list);
 }
 
-int read_cpu_topo_info(FILE *f, char *buf)
+/* the "name=id" fields of a CPU line, see outfile_topo_info() */
+static void read_topo_levels(const char *line, size_t len,
+			     struct topology_info *info)
+{
+	const char *end = line + len, *p;
+	char key[NAMELEN];
+	int level, sign;
+
+	for (level = TOPO_CLUSTER; level < TOPO_PACKAGE; level++) {
+		info->ids[level] = 0;
+
+		snprintf(key, sizeof(key), " %s=", topo_level_names[level]);
+		p = memmem(line, len, key, strlen(key));
+		if (!p)
+			continue;
+
+		p += strlen(key);
+		sign = p < end && *p == '-' ? -1 : 1;
+		for (p += sign < 0; p < end && isdigit(*p); p++)
+			info->ids[level] = info->ids[level] * 10 + *p - '0';
+		info->ids[level] *= sign;
+	}
+}
+
+/*
+ * Parse the topology block of an idlestat trace. @line holds the first
+ * line of the block and is left pointing to the first line following it.
+ */
+int read_cpu_topo_info(struct trace_file *tf, char **line, size_t *len)
 {
-	int ret = 0;
 	struct topology_info cpu_info;
 	bool is_ht = false;
-	char pid;
+	char *buf = *line;
 
-	do {
-		ret = sscanf(buf, "cluster%c", &pid);
-		if (!ret)
-			break;
+	while (buf && *len > strlen("cluster") &&
+	       !memcmp(buf, "cluster", strlen("cluster"))) {
 
-		cpu_info.physical_id = pid - 'A';
+		cpu_info.ids[TOPO_PACKAGE] = buf[strlen("cluster")] - 'A';
 
-		fgets(buf, BUFSIZE, f);
-		do {
-			ret = sscanf(buf, "\tcore%d", &cpu_info.core_id);
-			if (ret) {
+		buf = trace_file_getline(tf, len);
+		while (buf) {
+			if (!line_scan_int(buf, *len, "core",
+					   &cpu_info.ids[TOPO_CORE])) {
 				is_ht = true;
-				fgets(buf, BUFSIZE, f);
-			} else {
-				ret = sscanf(buf, "\tcpu%d", &cpu_info.cpu_id);
-				if (ret)
-					is_ht = false;
-				else
+				buf = trace_file_getline(tf, len);
+			} else if (!line_scan_int(buf, *len, "cpu",
+						  &cpu_info.cpu_id)) {
+				is_ht = false;
+			} else
+				break;
+
+			while (buf) {
+				if (line_scan_int(buf, *len, "cpu",
+						  &cpu_info.cpu_id))
 					break;
-			}
 
-			do {
-				if (!is_ht) {
-					ret = sscanf(buf, "\tcpu%d",
-						     &cpu_info.cpu_id);
-					cpu_info.core_id = cpu_info.cpu_id;
-				} else {
-					ret = sscanf(buf, "\t\tcpu%d",
-						     &cpu_info.cpu_id);
-				}
-
-				if (!ret)
-					break;
+				if (!is_ht)
+					cpu_info.ids[TOPO_CORE] =
+						cpu_info.cpu_id;
+
+				read_topo_levels(buf, *len, &cpu_info);
 
 				add_topo_info(&g_cpu_topo_list, &cpu_info);
 
-				fgets(buf, BUFSIZE, f);
-			} while (1);
-		} while (1);
-	} while (1);
+				buf = trace_file_getline(tf, len);
+			}
+		}
+	}
+
+	*line = buf;
 
 	/* output_topo_info(&g_cpu_topo_list); */
 
-	return 0;
+	return build_cpu_arrays(&g_cpu_topo_list);
+}
+
+/**
+ * restrict_cpu_topo_info - drop the CPUs of the topology which are not
+ * in the trace
+ * @nrcpus: number of CPUs of the trace
+ *
+ * The topology of this host is used for the traces which do not carry
+ * one, it may have more CPUs than the trace. The statistics only exist
+ * for the CPUs of the trace, the cores and the clusters are built from
+ * these CPUs only.
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int restrict_cpu_topo_info(int nrcpus)
+{
+	struct cpu_topology *topo_list = &g_cpu_topo_list;
+	int i, n = 0;
+
+	for (i = 0; i < topo_list->info_num; i++) {
+		if (topo_list->infos[i].cpu_id >= nrcpus)
+			continue;
+		topo_list->infos[n++] = topo_list->infos[i];
+	}
+
+	if (n == topo_list->info_num)
+		return 0;
+
+	topo_list->info_num = n;
+	for (i = 0; i < topo_list->cpu_index_size; i++)
+		topo_list->cpu_index[i] = -1;
+
+	return build_cpu_arrays(topo_list);
 }
 
 int release_cpu_topo_info(void)
 {
 	/* free alloced memory */
-	free_cpu_topology(&g_cpu_topo_list.physical_head);
+	free_cpu_topology(&g_cpu_topo_list);
 
 	return 0;
 }
@@ -414,9 +627,140 @@ int output_cpu_topo_info(FILE *f)
 	return 0;
 }
 
-int establish_idledata_to_topo(struct cpuidle_datas *datas)
+/*
+ * The cores and the clusters are computed after the import by a pool of
+ * threads: one task per hyper-threaded core, then one task per C-state
+ * of each cluster, or per cluster by depth. The cores are complete
+ * before the clusters are intersected from them. Each task intersects
+ * in its own arena, the arenas of a cluster are merged at the end.
+ */
+struct cluster_task {
+	struct cpu_core *core;
+	struct cpu_group *group;
+	struct cpuidle_cstates *result;	/* of the group */
+	int state;			/* -1 for the whole group */
+	int at_least;
+	int ret;
+	struct arena arena;
+};
+
+static void core_cluster_task(void *arg)
+{
+	struct cluster_task *task = arg;
+
+	task->core->cstates = core_cluster_data(task->core, task->at_least);
+}
+
+static void group_cluster_task(void *arg)
+{
+	struct cluster_task *task = arg;
+
+	if (task->state < 0)
+		task->group->cstates = group_cluster_data(task->group,
+							  task->at_least);
+	else
+		task->ret = group_cluster_state(task->group, task->result,
+						task->state, &task->arena);
+}
+
+/* run the tasks in the pool, or in the calling thread without a pool */
+static void cluster_tasks_wait(struct thread_pool *pool,
+			       struct cluster_task *tasks, int n,
+			       pool_fn_t fn)
 {
-	struct cpu_physical *s_phy;
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (!pool || pool_submit(pool, fn, &tasks[i]))
+			fn(&tasks[i]);
+
+	if (pool)
+		pool_wait(pool);
+}
+
+static int cluster_tasks_run(struct cpu_topology *topo, int level,
+			     int at_least)
+{
+	struct thread_pool *pool = NULL;
+	struct cluster_task *tasks, *task;
+	struct cpu_group    *g;
+	struct cpu_core     *s_core;
+	int i, n, nrthreads;
+
+	tasks = calloc(topo->core_num + topo->group_num[level] * MAXCSTATE,
+		       sizeof(*tasks));
+	if (!tasks)
+		return -1;
+
+	/* a core of a single CPU is the CPU itself */
+	n = 0;
+	topo_for_each_core(topo, s_core) {
+		if (s_core->cstates)
+			continue;
+		if (!s_core->is_ht) {
+			s_core->cstates = core_cluster_data(s_core, at_least);
+			continue;
+		}
+		tasks[n].core = s_core;
+		tasks[n++].at_least = at_least;
+	}
+
+	nrthreads = MIN(MAX(n, topo->group_num[level] * MAXCSTATE),
+			sysconf(_SC_NPROCESSORS_ONLN));
+	if (nrthreads > 1)
+		pool = pool_create(nrthreads);
+
+	cluster_tasks_wait(pool, tasks, n, core_cluster_task);
+
+	n = 0;
+	topo_for_each_group(topo, level, g) {
+		if (g->cstates)
+			continue;
+
+		if (at_least) {
+			tasks[n].group = g;
+			tasks[n].state = -1;
+			tasks[n++].at_least = at_least;
+			continue;
+		}
+
+		g->cstates = group_cluster_alloc(g);
+		if (!g->cstates)
+			continue;
+
+		for (i = 0; i < g->cstates->cstate_max + 1; i++) {
+			tasks[n].group = g;
+			tasks[n].result = g->cstates;
+			tasks[n++].state = i;
+		}
+	}
+
+	cluster_tasks_wait(pool, tasks, n, group_cluster_task);
+	pool_destroy(pool);
+
+	/* join the states of each cluster, drop the incomplete ones */
+	for (task = tasks; task < tasks + n; task++)
+		if (task->state >= 0)
+			arena_splice(&task->result->arena, &task->arena);
+
+	for (task = tasks; task < tasks + n; task++) {
+		if (!task->ret || task->group->cstates != task->result)
+			continue;
+
+		arena_release(&task->result->arena);
+		free(task->result);
+		task->group->cstates = NULL;
+	}
+
+	free(tasks);
+
+	return 0;
+}
+
+int establish_idledata_to_topo(struct cpuidle_datas *datas, int at_least,
+			       int level)
+{
+	struct cpu_group    *g;
 	struct cpu_core     *s_core;
 	struct cpu_cpu      *s_cpu;
 	int    i;
@@ -434,41 +778,111 @@ int establish_idledata_to_topo(struct cpuidle_datas *datas)
 	if (!has_topo)
 		return -1;
 
-	list_for_each_entry(s_phy, &g_cpu_topo_list.physical_head,
-			    list_physical)
-		list_for_each_entry(s_core, &s_phy->core_head, list_core)
-			s_core->cstates = core_cluster_data(s_core);
+	g_cpu_topo_list.level = level;
 
-	list_for_each_entry(s_phy, &g_cpu_topo_list.physical_head,
-			    list_physical)
-		s_phy->cstates = physical_cluster_data(s_phy);
+	/* the groups followed while importing are already complete */
+	topo_for_each_core(&g_cpu_topo_list, s_core)
+		s_core->cstates = datas->clusters ?
+			cluster_group_take(datas->clusters, CLUSTER_CORE,
+					   s_core->cpus[0].cpu_id, datas) :
+			NULL;
 
-	return 0;
+	topo_for_each_group(&g_cpu_topo_list, level, g)
+		g->cstates = datas->clusters ?
+			cluster_group_take(datas->clusters, CLUSTER_PACKAGE,
+					   g->cpus[0].cpu_id, datas) : NULL;
+
+	return cluster_tasks_run(&g_cpu_topo_list, level, at_least);
+}
+
+/**
+ * cpu_topo_cluster_tracker - follow the C-states of the cores and the
+ * clusters while importing
+ * @nrcpus: number of CPUs of the trace
+ * @at_least: a group is in a C-state while its CPUs are in it or deeper
+ * @level: the level of the topology reported as the clusters
+ *
+ * Return: the tracker, NULL if the topology does not match the trace or
+ * if out of memory
+ */
+struct cluster_tracker *cpu_topo_cluster_tracker(int nrcpus, int at_least,
+						 int level)
+{
+	struct cluster_tracker *t;
+	struct cpu_group    *g;
+	struct cpu_core     *s_core;
+	struct cpu_cpu      *s_cpu;
+	int *cpus, n, first;
+
+	if (!g_cpu_topo_list.group_num[level])
+		return NULL;
+
+	t = cluster_tracker_create(nrcpus, at_least);
+	cpus = malloc(nrcpus * sizeof(*cpus));
+	if (!t || !cpus)
+		goto fail;
+
+	topo_for_each_group(&g_cpu_topo_list, level, g) {
+		n = 0;
+		group_for_each_core(g, s_core) {
+			first = n;
+			core_for_each_cpu(s_core, s_cpu) {
+				if (s_cpu->cpu_id >= nrcpus)
+					goto fail;
+				cpus[n++] = s_cpu->cpu_id;
+			}
+
+			if (s_core->is_ht &&
+			    cluster_group_create(t, CLUSTER_CORE, cpus + first,
+						 n - first))
+				goto fail;
+		}
+
+		/* a single CPU is its own cluster */
+		if (n > 1 && cluster_group_create(t, CLUSTER_PACKAGE, cpus, n))
+			goto fail;
+	}
+
+	free(cpus);
+
+	return t;
+fail:
+	free(cpus);
+	cluster_tracker_release(t);
+
+	return NULL;
+}
+
+/* the packages keep their historical names */
+static void topo_group_name(char *name, struct cpu_group *g)
+{
+	if (g->level == TOPO_PACKAGE)
+		sprintf(name, "cluster%c", g->id + 'A');
+	else
+		sprintf(name, "%s%d", topo_level_names[g->level], g->id);
 }
 
 int dump_cpu_topo_info(int (*dump)(void *, char *), int cstate)
 {
-	struct cpu_physical *s_phy;
+	struct cpu_group    *g;
 	struct cpu_core     *s_core;
 	struct cpu_cpu      *s_cpu;
 	char tmp[30];
 
-	list_for_each_entry(s_phy, &g_cpu_topo_list.physical_head,
-			    list_physical) {
+	topo_for_each_group(&g_cpu_topo_list, g_cpu_topo_list.level, g) {
 
-		sprintf(tmp, "cluster%c", s_phy->physical_id + 'A');
+		topo_group_name(tmp, g);
 
 		if (cstate)
-			dump(s_phy->cstates, tmp);
+			dump(g->cstates, tmp);
 
-		list_for_each_entry(s_core, &s_phy->core_head, list_core) {
+		group_for_each_core(g, s_core) {
 			if (s_core->is_ht && cstate) {
 				sprintf(tmp, "core%d", s_core->core_id);
 				dump(s_core->cstates, tmp);
 			}
 
-			list_for_each_entry(s_cpu, &s_core->cpu_head,
-					    list_cpu) {
+			core_for_each_cpu(s_core, s_cpu) {
 				sprintf(tmp, "cpu%d", s_cpu->cpu_id);
 				dump(cstate ?
 				     (void *)s_cpu->cstates :
@@ -480,21 +894,118 @@ int dump_cpu_topo_info(int (*dump)(void *, char *), int cstate)
 	return 0;
 }
 
+/**
+ * dump_cpu_topo_concurrency - report how many CPUs were idle together
+ * @datas: the per-CPU statistics
+ * @dump: called with the histogram of each cluster, then with the one
+ * of all the CPUs
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int dump_cpu_topo_concurrency(struct cpuidle_datas *datas,
+			      int (*dump)(void *, char *))
+{
+	struct idle_concurrency *phys, all, **groups;
+	struct cpuidle_cstates **cpus;
+	struct cpu_group    *g;
+	struct cpu_cpu      *s_cpu;
+	int level = g_cpu_topo_list.level;
+	int i, n, ret = -1;
+	char tmp[30];
+
+	phys = calloc(g_cpu_topo_list.group_num[level], sizeof(*phys));
+	groups = calloc(datas->nrcpus, sizeof(*groups));
+	cpus = malloc(datas->nrcpus * sizeof(*cpus));
+	all.nrcpus = datas->nrcpus;
+	all.idle = 0;
+	all.time = calloc(datas->nrcpus + 1, sizeof(*all.time));
+	if (!phys || !groups || !cpus || !all.time)
+		goto out;
+
+	for (i = 0; i < datas->nrcpus; i++)
+		cpus[i] = &datas->cstates[i];
+
+	/* the CPUs of the trace missing from the topology are in no
+	 * cluster, they still count for the whole system */
+	n = 0;
+	topo_for_each_group(&g_cpu_topo_list, level, g) {
+		group_for_each_cpu(g, s_cpu) {
+			if (s_cpu->cpu_id >= datas->nrcpus)
+				continue;
+			groups[s_cpu->cpu_id] = &phys[n];
+			phys[n].nrcpus++;
+		}
+
+		phys[n].time = calloc(phys[n].nrcpus + 1,
+				      sizeof(*phys[n].time));
+		if (!phys[n++].time)
+			goto out;
+	}
+
+	if (cstates_concurrency_sweep(cpus, groups, datas->nrcpus, &all))
+		goto out;
+
+	n = 0;
+	topo_for_each_group(&g_cpu_topo_list, level, g) {
+		topo_group_name(tmp, g);
+		dump(&phys[n++], tmp);
+	}
+
+	dump(&all, "all");
+
+	ret = 0;
+out:
+	for (i = 0; phys && i < g_cpu_topo_list.group_num[level]; i++)
+		free(phys[i].time);
+	free(phys);
+	free(groups);
+	free(cpus);
+	free(all.time);
+
+	return ret;
+}
+
+/**
+ * cpu_topo_arena_usage - account the arenas of the clusters and cores
+ * @usage: the arena holding the total
+ */
+void cpu_topo_arena_usage(struct arena *usage)
+{
+	struct cpu_group    *g;
+	struct cpu_core     *s_core;
+	int level;
+
+	for (level = TOPO_CLUSTER; level < TOPO_LEVELS; level++)
+		topo_for_each_group(&g_cpu_topo_list, level, g)
+			if (g->cstates)
+				arena_usage(usage, &g->cstates->arena);
+
+	topo_for_each_core(&g_cpu_topo_list, s_core)
+		if (s_core->is_ht && s_core->cstates)
+			arena_usage(usage, &s_core->cstates->arena);
+}
+
 int release_cpu_topo_cstates(void)
 {
-	struct cpu_physical *s_phy;
+	struct cpu_group    *g;
 	struct cpu_core     *s_core;
+	int level;
+
+	for (level = TOPO_CLUSTER; level < TOPO_LEVELS; level++)
+		topo_for_each_group(&g_cpu_topo_list, level, g) {
+			if (g->cstates)
+				arena_release(&g->cstates->arena);
+			free(g->cstates);
+			g->cstates = NULL;
+		}
 
-	list_for_each_entry(s_phy, &g_cpu_topo_list.physical_head,
-			    list_physical) {
-		free(s_phy->cstates);
-		s_phy->cstates = NULL;
-		list_for_each_entry(s_core, &s_phy->core_head, list_core)
-			if (s_core->is_ht) {
-				free(s_core->cstates);
-				s_core->cstates = NULL;
-			}
-	}
+	topo_for_each_core(&g_cpu_topo_list, s_core)
+		if (s_core->is_ht) {
+			if (s_core->cstates)
+				arena_release(&s_core->cstates->arena);
+			free(s_core->cstates);
+			s_core->cstates = NULL;
+		}
 
 	return 0;
 }
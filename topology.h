@@ -27,49 +27,132 @@
 #ifndef __TOPOLOGY_H
 #define __TOPOLOGY_H
 
-#include "list.h"
+#include <stdbool.h>
+#include <stdio.h>
+
 #include "idlestat.h"
+#include "tracefile.h"
+
+/*
+ * The levels of the topology, from the bottom. A level missing from the
+ * description of a CPU takes the id 0, its groups are then the ones of
+ * the level above.
+ */
+enum topo_level {
+	TOPO_CORE = 0,
+	TOPO_CLUSTER,		/* cluster_id, the cores sharing an L2 */
+	TOPO_LLC,		/* the CPUs sharing the last level cache */
+	TOPO_NODE,		/* NUMA node */
+	TOPO_DIE,
+	TOPO_PACKAGE,		/* reported as the clusters by default */
+	TOPO_LEVELS
+};
 
+/*
+ * The topology is held in flat arrays. The CPUs are sorted by their ids
+ * at each level from the package down to the core, so the CPUs of a core
+ * and the cores, the CPUs and the child groups of a group are contiguous
+ * ranges of the arrays. A group is identified by its id and the ones of
+ * all the levels above it, the levels are always nested: a node across
+ * two packages is split in two groups. A CPU is found from its id with
+ * one lookup in the index.
+ */
 struct cpu_cpu {
-	struct list_head list_cpu;
 	int cpu_id;
+	int ids[TOPO_LEVELS];		/* as read, at each level */
+	struct cpu_core *core;
 	struct cpuidle_cstates *cstates;
 	struct cpufreq_pstates *pstates;
 };
 
 struct cpu_core {
-	struct list_head list_core;
 	int core_id;
-	struct list_head cpu_head;
+	struct cpu_group *cluster;	/* its group at the level above */
+	struct cpu_cpu *cpus;		/* its CPUs */
 	int cpu_num;
 	bool is_ht;
 	struct cpuidle_cstates *cstates;
 };
 
-struct cpu_physical {
-	struct list_head list_physical;
-	int physical_id;
-	struct list_head core_head;
+struct cpu_group {
+	int level;
+	int id;				/* the package id for the packages,
+					 * the index in the level otherwise */
+	struct cpu_group *children;	/* its groups at the level below */
+	int child_num;
+	struct cpu_core *cores;		/* its cores */
 	int core_num;
-	struct cpuidle_cstates *cstates;
+	struct cpu_cpu *cpus;		/* the CPUs of all its cores */
+	int cpu_num;
+	struct cpuidle_cstates *cstates;	/* at the reported level only */
 };
 
+struct topology_info;
+
 struct cpu_topology {
-	struct list_head physical_head;
-	int physical_num;
+	struct cpu_group *groups[TOPO_LEVELS];	/* none for the cores */
+	int group_num[TOPO_LEVELS];
+	struct cpu_core *cores;
+	int core_num;
+	struct cpu_cpu *cpus;
+	int cpu_num;
+	int level;			/* reported as the clusters */
+	int *cpu_index;			/* by CPU id, -1 if not present */
+	int cpu_index_size;
+	struct topology_info *infos;	/* as read, the arrays are built
+					 * from them */
+	int info_num;
 };
 
+#define topo_for_each_group(topo, level, g)				\
+	for ((g) = (topo)->groups[level];				\
+	     (g) < (topo)->groups[level] + (topo)->group_num[level]; (g)++)
+
+#define topo_for_each_core(topo, core)					\
+	for ((core) = (topo)->cores;					\
+	     (core) < (topo)->cores + (topo)->core_num; (core)++)
+
+#define group_for_each_child(g, child)					\
+	for ((child) = (g)->children;					\
+	     (child) < (g)->children + (g)->child_num; (child)++)
+
+#define group_for_each_core(g, core)					\
+	for ((core) = (g)->cores; (core) < (g)->cores + (g)->core_num;	\
+	     (core)++)
+
+#define group_for_each_cpu(g, cpu)					\
+	for ((cpu) = (g)->cpus; (cpu) < (g)->cpus + (g)->cpu_num; (cpu)++)
+
+#define core_for_each_cpu(core, cpu)					\
+	for ((cpu) = (core)->cpus; (cpu) < (core)->cpus + (core)->cpu_num; \
+	     (cpu)++)
+
 extern int init_cpu_topo_info(void);
-extern int read_cpu_topo_info(FILE *f, char *buf);
+extern int read_cpu_topo_info(struct trace_file *tf, char **line,
+			      size_t *len);
 extern int read_sysfs_cpu_topo(void);
+extern int restrict_cpu_topo_info(int nrcpus);
 extern int release_cpu_topo_info(void);
 extern int output_cpu_topo_info(FILE *f);
-extern int establish_idledata_to_topo(struct cpuidle_datas *datas);
+extern int topo_level_parse(const char *name);
+extern int establish_idledata_to_topo(struct cpuidle_datas *datas,
+				      int at_least, int level);
+extern struct cluster_tracker *cpu_topo_cluster_tracker(int nrcpus,
+							int at_least,
+							int level);
 extern int release_cpu_topo_cstates(void);
+extern void cpu_topo_arena_usage(struct arena *usage);
 extern int dump_cpu_topo_info(int (*dump)(void *, char *), int pstate);
+extern int dump_cpu_topo_concurrency(struct cpuidle_datas *datas,
+				     int (*dump)(void *, char *));
 
-extern struct cpuidle_cstates *core_cluster_data(struct cpu_core *s_core);
-extern struct cpuidle_cstates *
-	physical_cluster_data(struct cpu_physical *s_phy);
+extern struct cpuidle_cstates *core_cluster_data(struct cpu_core *s_core,
+						 int at_least);
+extern struct cpuidle_cstates *group_cluster_data(struct cpu_group *g,
+						  int at_least);
+extern struct cpuidle_cstates *group_cluster_alloc(struct cpu_group *g);
+extern int group_cluster_state(struct cpu_group *g,
+			       struct cpuidle_cstates *result, int state,
+			       struct arena *arena);
 
 #endif
@@ -33,6 +33,7 @@
 
 #include "trace.h"
 #include "utils.h"
+#include "parser.h"
 
 int idlestat_trace_enable(bool enable)
 {
@@ -46,7 +47,9 @@ int idlestat_flush_trace(void)
 
 int idlestat_init_trace(unsigned int duration)
 {
-	int bufsize;
+	const struct event_desc *desc;
+	char *path;
+	int bufsize, ret;
 
 	/* Assuming the worst case where we can have for cpuidle,
 	 * TRACE_IDLE_NRHITS_PER_SEC.  Each state enter/exit line are
@@ -72,22 +75,19 @@ int idlestat_init_trace(unsigned int duration)
 	if (write_int(TRACE_EVENT_PATH, 0))
 		return -1;
 
-	/* Enable cpu_idle traces */
-	if (write_int(TRACE_CPUIDLE_EVENT_PATH, 1))
-		return -1;
-
-	/* Enable cpu_frequency traces */
-	if (write_int(TRACE_CPUFREQ_EVENT_PATH, 1))
-		return -1;
+	/* Enable the events idlestat knows about, ignore the optional
+	 * ones if not present, for backward compatibility */
+	for_each_event_desc(desc) {
+		if (asprintf(&path, TRACE_EVENT_ENABLE_PATH_FORMAT,
+			     desc->system, desc->name) < 0)
+			return -1;
 
-	/* Enable irq traces */
-	if (write_int(TRACE_IRQ_EVENT_PATH, 1))
-		return -1;
+		ret = write_int(path, 1);
+		free(path);
 
-	/* Enable ipi traces..
-	 * Ignore if not present, for backward compatibility
-	 */
-	write_int(TRACE_IPI_EVENT_PATH, 1);
+		if (ret && !desc->optional)
+			return -1;
+	}
 
 	return 0;
 }
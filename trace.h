@@ -26,13 +26,16 @@
 #define TRACE_ON_PATH TRACE_PATH "/tracing_on"
 #define TRACE_BUFFER_SIZE_PATH TRACE_PATH "/buffer_size_kb"
 #define TRACE_BUFFER_TOTAL_PATH TRACE_PATH "/buffer_total_size_kb"
-#define TRACE_CPUIDLE_EVENT_PATH TRACE_PATH "/events/power/cpu_idle/enable"
-#define TRACE_CPUFREQ_EVENT_PATH TRACE_PATH "/events/power/cpu_frequency/enable"
-#define TRACE_IRQ_EVENT_PATH TRACE_PATH "/events/irq/irq_handler_entry/enable"
-#define TRACE_IPI_EVENT_PATH TRACE_PATH "/events/ipi/ipi_entry/enable"
+#define TRACE_EVENT_ENABLE_PATH_FORMAT TRACE_PATH "/events/%s/%s/enable"
 #define TRACE_EVENT_PATH TRACE_PATH "/events/enable"
 #define TRACE_FREE TRACE_PATH "/free_buffer"
 #define TRACE_FILE TRACE_PATH "/trace"
+#define TRACE_HEADER_PAGE_PATH TRACE_PATH "/events/header_page"
+#define TRACE_HEADER_EVENT_PATH TRACE_PATH "/events/header_event"
+#define TRACE_EVENT_FORMAT_PATH_FORMAT TRACE_PATH "/events/%s/%s/format"
+#define TRACE_PRINTK_FORMATS_PATH TRACE_PATH "/printk_formats"
+#define TRACE_CPU_RAW_PATH_FORMAT TRACE_PATH "/per_cpu/cpu%d/trace_pipe_raw"
+#define TRACE_CPU_TRACE_PATH_FORMAT TRACE_PATH "/per_cpu/cpu%d/trace"
 #define TRACE_IDLE_NRHITS_PER_SEC 10000
 #define TRACE_IDLE_LENGTH 196
 #define TRACE_CPUFREQ_NRHITS_PER_SEC 100
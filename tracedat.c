@@ -0,0 +1,1306 @@
+/*
+ *  tracedat.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "tracedat.h"
+#include "merge.h"
+#include "compress.h"
+#include "parser.h"
+#include "scan.h"
+#include "spill.h"
+#include "topology.h"
+#include "trace.h"
+#include "utils.h"
+#include "list.h"
+
+/*
+ * Import of the binary files recorded by 'trace-cmd record', version 6.
+ * The file starts with a description of the ring buffer pages and of
+ * the events, followed by the raw ring buffer pages of each CPU. The
+ * pages are decoded in place from the mapped file and the events of
+ * the CPUs are merged in time order, no text is ever produced.
+ */
+
+#define TRACE_DAT_MAGIC		"\027\010\104tracing"
+#define TRACE_DAT_MAGIC_LEN	10
+#define TRACE_DAT_VERSION	"6"
+
+/*
+ * The topology of the traced host, in the idlestat text format. This is
+ * a private option, far from the range allocated by trace-cmd which
+ * skips the options it does not know.
+ */
+#define TRACE_DAT_OPTION_TOPOLOGY	0x8000
+
+/* ring buffer event header, see include/linux/ring_buffer.h */
+#define RB_TS_SHIFT		27
+#define RB_TS_MASK		((1U << RB_TS_SHIFT) - 1)
+#define RB_TYPE_LEN_MASK	0x1f
+#define RB_TYPE_PADDING		29
+#define RB_TYPE_TIME_EXTEND	30
+#define RB_TYPE_TIME_STAMP	31
+/* the upper bits of the page commit field are flags */
+#define RB_COMMIT_MASK		((1U << 27) - 1)
+
+/* events decoded at once from a CPU buffer, to keep the reads sequential */
+#define TRACE_DAT_BATCH		64
+
+struct trace_dat_field {
+	unsigned int offset;
+	unsigned int size;
+	bool data_loc;		/* dynamic array, the field locates it */
+};
+
+struct trace_dat_event {
+	unsigned int id;
+	const struct event_desc *desc;
+	struct trace_dat_field fields[2];
+};
+
+/* a string referenced by its kernel address, eg. the ipi reason */
+struct trace_dat_string {
+	uint64_t addr;
+	const char *str;
+	size_t len;
+};
+
+struct trace_dat_cpu {
+	struct event_source src;
+	struct trace_dat *td;
+	const char *page;	/* next page */
+	const char *end;	/* end of the CPU buffer */
+	const char *p;		/* next event in the current page */
+	const char *pend;	/* end of the data in the current page */
+	char *buf;		/* copy of the current page, when read */
+	uint64_t time;
+	int nrevents;		/* decoded events */
+	int next;		/* next decoded event to return */
+	struct trace_event events[TRACE_DAT_BATCH];
+};
+
+struct trace_dat {
+	const char *data;
+	size_t size;
+	int fd;			/* the pages are read from it when >= 0 */
+	bool swap;		/* the file endianness is not the host one */
+	bool big_endian;
+	int long_size;
+	unsigned int page_size;
+	struct trace_dat_field page_ts;
+	struct trace_dat_field page_commit;
+	struct trace_dat_field page_data;
+	struct trace_dat_event *events;
+	int nrevents;
+	struct trace_dat_string *strings;
+	int nrstrings;
+	struct trace_dat_cpu *cpus;
+	int nrcpus;
+	const char *topology;
+	size_t topology_len;
+};
+
+/* sequential reader of the file headers */
+struct cursor {
+	const char *p;
+	const char *end;
+	int error;
+};
+
+static inline uint16_t td_u16(struct trace_dat *td, const char *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return td->swap ? __builtin_bswap16(v) : v;
+}
+
+static inline uint32_t td_u32(struct trace_dat *td, const char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return td->swap ? __builtin_bswap32(v) : v;
+}
+
+static inline uint64_t td_u64(struct trace_dat *td, const char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return td->swap ? __builtin_bswap64(v) : v;
+}
+
+static inline uint64_t td_read(struct trace_dat *td, const char *p,
+			       unsigned int size)
+{
+	switch (size) {
+	case 1:
+		return *(const uint8_t *)p;
+	case 2:
+		return td_u16(td, p);
+	case 4:
+		return td_u32(td, p);
+	case 8:
+		return td_u64(td, p);
+	}
+
+	return 0;
+}
+
+static const char *cursor_take(struct cursor *c, size_t size)
+{
+	const char *p = c->p;
+
+	if (c->error || (size_t)(c->end - c->p) < size) {
+		c->error = 1;
+		return NULL;
+	}
+
+	c->p += size;
+
+	return p;
+}
+
+static uint32_t cursor_u32(struct trace_dat *td, struct cursor *c)
+{
+	const char *p = cursor_take(c, sizeof(uint32_t));
+
+	return p ? td_u32(td, p) : 0;
+}
+
+static uint64_t cursor_u64(struct trace_dat *td, struct cursor *c)
+{
+	const char *p = cursor_take(c, sizeof(uint64_t));
+
+	return p ? td_u64(td, p) : 0;
+}
+
+/* return the NUL-terminated string at the cursor */
+static const char *cursor_string(struct cursor *c)
+{
+	const char *p = c->p, *nul;
+
+	if (c->error)
+		return "";
+
+	nul = scan_char(p, c->end, '\0');
+	if (!nul) {
+		c->error = 1;
+		return "";
+	}
+
+	c->p = nul + 1;
+
+	return p;
+}
+
+/* take a block of text preceded by its size on @size_len bytes */
+static const char *cursor_text(struct trace_dat *td, struct cursor *c,
+			       size_t size_len, size_t *len)
+{
+	*len = size_len == sizeof(uint64_t) ?
+		cursor_u64(td, c) : cursor_u32(td, c);
+
+	return cursor_take(c, *len);
+}
+
+/*
+ * Parse a "field:<type> <name>;\toffset:<n>;\tsize:<n>;" line of a format
+ * description. Return the name of the field and its length in @len.
+ */
+static const char *parse_format_field(const char *line, const char *end,
+				      struct trace_dat_field *field,
+				      size_t *len)
+{
+	const char *decl, *semi, *name, *p;
+	int offset, size;
+
+	decl = memmem(line, end - line, "field:", 6);
+	if (!decl)
+		return NULL;
+	decl += 6;
+
+	semi = scan_char(decl, end, ';');
+	if (!semi)
+		return NULL;
+
+	/* the name is the last word of the declaration, without the
+	 * array size */
+	name = semi;
+	if (name > decl && name[-1] == ']')
+		while (name > decl && *name != '[')
+			name--;
+	p = name;
+	while (name > decl && (isalnum(name[-1]) || name[-1] == '_'))
+		name--;
+	*len = p - name;
+
+	p = memmem(semi, end - semi, "offset:", 7);
+	if (!p || line_scan_int(p, end - p, "offset:", &offset))
+		return NULL;
+
+	p = memmem(semi, end - semi, "size:", 5);
+	if (!p || line_scan_int(p, end - p, "size:", &size))
+		return NULL;
+
+	while (decl < name && isspace(*decl))
+		decl++;
+
+	field->offset = offset;
+	field->size = size;
+	field->data_loc = !strncmp(decl, "__data_loc", 10);
+
+	return name;
+}
+
+/* the layout of the ring buffer pages */
+static int parse_header_page(struct trace_dat *td, const char *text,
+			     size_t len)
+{
+	const char *line = text, *end = text + len, *eol, *name;
+	struct trace_dat_field field;
+	size_t namelen;
+
+	/* the kernel layout, in case the description is incomplete */
+	td->page_ts = (struct trace_dat_field){ 0, 8, false };
+	td->page_commit = (struct trace_dat_field){ 8, td->long_size, false };
+	td->page_data = (struct trace_dat_field){ 8 + td->long_size, 0, false };
+
+	for (; line < end; line = eol + 1) {
+		eol = scan_char(line, end, '\n');
+		if (!eol)
+			eol = end;
+
+		name = parse_format_field(line, eol, &field, &namelen);
+		if (!name)
+			continue;
+
+		if (namelen == 9 && !memcmp(name, "timestamp", 9))
+			td->page_ts = field;
+		else if (namelen == 6 && !memcmp(name, "commit", 6))
+			td->page_commit = field;
+		else if (namelen == 4 && !memcmp(name, "data", 4))
+			td->page_data = field;
+	}
+
+	if (td->page_ts.offset + 8 > td->page_data.offset ||
+	    td->page_commit.offset + td->page_commit.size >
+	    td->page_data.offset || td->page_data.offset >= td->page_size) {
+		fprintf(stderr, "%s: invalid ring buffer page layout\n",
+			__func__);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Parse the format description of an event and keep it if it is one
+ * idlestat knows about. Unknown events are silently ignored.
+ */
+static int parse_event_format(struct trace_dat *td, const char *system,
+			      const char *text, size_t len)
+{
+	const char *line = text, *end = text + len, *eol, *name;
+	const char *evname = NULL;
+	size_t evlen = 0, namelen;
+	struct trace_dat_event event = { 0 }, *tmp;
+	struct trace_dat_field field;
+	bool found[2] = { false, false };
+	int id = -1, i;
+
+	for (; line < end; line = eol + 1) {
+		eol = scan_char(line, end, '\n');
+		if (!eol)
+			eol = end;
+
+		if (!evname && eol - line > 6 && !memcmp(line, "name: ", 6)) {
+			evname = line + 6;
+			evlen = eol - evname;
+			event.desc = event_desc_lookup(evname, evlen);
+			if (!event.desc || strcmp(event.desc->system, system))
+				return 0;
+			continue;
+		}
+
+		if (id < 0 && !line_scan_int(line, eol - line, "ID: ", &id))
+			continue;
+
+		if (!event.desc)
+			continue;
+
+		name = parse_format_field(line, eol, &field, &namelen);
+		if (!name)
+			continue;
+
+		for (i = 0; i < 2; i++) {
+			if (event.desc->fields[i] &&
+			    strlen(event.desc->fields[i]) == namelen &&
+			    !memcmp(event.desc->fields[i], name, namelen)) {
+				event.fields[i] = field;
+				found[i] = true;
+			}
+		}
+	}
+
+	if (!event.desc)
+		return 0;
+
+	for (i = 0; i < 2; i++) {
+		if (event.desc->fields[i] && !found[i]) {
+			fprintf(stderr, "%s: no field '%s' in event %s:%s\n",
+				__func__, event.desc->fields[i], system,
+				event.desc->name);
+			return 0;
+		}
+	}
+
+	if (id < 0) {
+		fprintf(stderr, "%s: no id for event %s:%s\n", __func__,
+			system, event.desc->name);
+		return 0;
+	}
+
+	event.id = id;
+
+	tmp = realloc(td->events, sizeof(*tmp) * (td->nrevents + 1));
+	if (!tmp)
+		return -1;
+
+	td->events = tmp;
+	td->events[td->nrevents++] = event;
+
+	return 0;
+}
+
+static int string_cmp(const void *a, const void *b)
+{
+	const struct trace_dat_string *s1 = a, *s2 = b;
+
+	return s1->addr < s2->addr ? -1 : s1->addr > s2->addr;
+}
+
+/* the printk formats, lines looking like: 0xffffffff8107a2d0 : "text" */
+static int parse_printk_formats(struct trace_dat *td, const char *text,
+				size_t len)
+{
+	const char *line = text, *end = text + len, *eol, *str, *p;
+	struct trace_dat_string *tmp;
+	uint64_t addr;
+
+	for (; line < end; line = eol + 1) {
+		eol = scan_char(line, end, '\n');
+		if (!eol)
+			eol = end;
+
+		if (eol - line < 3 || line[0] != '0' || line[1] != 'x')
+			continue;
+
+		for (addr = 0, p = line + 2; p < eol && isxdigit(*p); p++)
+			addr = (addr << 4) |
+				(isdigit(*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+
+		str = scan_char(p, eol, '"');
+		if (!str)
+			continue;
+		str++;
+
+		p = eol;
+		while (p > str && p[-1] != '"')
+			p--;
+		if (p == str)
+			continue;
+
+		tmp = realloc(td->strings, sizeof(*tmp) * (td->nrstrings + 1));
+		if (!tmp)
+			return -1;
+
+		td->strings = tmp;
+		td->strings[td->nrstrings].addr = addr;
+		td->strings[td->nrstrings].str = str;
+		td->strings[td->nrstrings].len = p - 1 - str;
+		td->nrstrings++;
+	}
+
+	qsort(td->strings, td->nrstrings, sizeof(*td->strings), string_cmp);
+
+	return 0;
+}
+
+static int parse_flyrecord(struct trace_dat *td, struct cursor *c)
+{
+	uint64_t offset, size;
+	int cpu;
+
+	td->cpus = calloc(td->nrcpus, sizeof(*td->cpus));
+	if (!td->cpus)
+		return -1;
+
+	for (cpu = 0; cpu < td->nrcpus; cpu++) {
+		offset = cursor_u64(td, c);
+		size = cursor_u64(td, c);
+		if (c->error || offset > td->size || size > td->size - offset)
+			return -1;
+
+		td->cpus[cpu].td = td;
+		td->cpus[cpu].page = td->data + offset;
+		td->cpus[cpu].end = td->data + offset + size;
+
+		if (td->fd < 0)
+			continue;
+		td->cpus[cpu].buf = malloc(td->page_size);
+		if (!td->cpus[cpu].buf)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * trace_dat_match - tell if a file is a trace-cmd binary file
+ * @data: the beginning of the file
+ * @len: the length of @data
+ *
+ * Return: true if the file starts with the trace-cmd magic
+ */
+bool trace_dat_match(const char *data, size_t len)
+{
+	return len >= TRACE_DAT_MAGIC_LEN &&
+		!memcmp(data, TRACE_DAT_MAGIC, TRACE_DAT_MAGIC_LEN);
+}
+
+/**
+ * trace_dat_open - read the headers of a trace-cmd binary file
+ * @tf: the trace file, streamed files are read in memory
+ *
+ * Return: the decoder or NULL on error
+ */
+struct trace_dat *trace_dat_open(struct trace_file *tf)
+{
+	struct cursor c = { .p = tf->map, .end = tf->map + tf->size };
+	struct trace_dat *td;
+	const char *p, *version, *text;
+	uint32_t count, nrevents, i, j;
+	uint16_t option;
+	size_t len;
+
+	/* the decoder walks the CPU buffers at once, a streamed file is
+	 * read in memory first */
+	if (trace_file_load(tf)) {
+		fprintf(stderr, "%s: failed to read the trace in memory\n",
+			__func__);
+		return NULL;
+	}
+	c.p = tf->map;
+	c.end = tf->map + tf->size;
+
+	td = calloc(1, sizeof(*td));
+	if (!td)
+		return NULL;
+
+	td->data = tf->map;
+	td->size = tf->size;
+	/* touching a page of the mapping may map the whole large folio
+	 * around it, up to a few MB for each CPU buffer walked at once:
+	 * with a memory limit, the pages are read instead */
+	td->fd = spill.limit && !tf->buf ? tf->fd : -1;
+
+	cursor_take(&c, TRACE_DAT_MAGIC_LEN);
+	version = cursor_string(&c);
+	if (strcmp(version, TRACE_DAT_VERSION)) {
+		fprintf(stderr, "%s: unsupported trace-cmd file version '%s'\n",
+			__func__, version);
+		goto out_free;
+	}
+
+	p = cursor_take(&c, 2);
+	if (!p)
+		goto out_corrupted;
+	td->big_endian = p[0];
+	td->long_size = p[1];
+	td->swap = td->big_endian !=
+		(__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+	td->page_size = cursor_u32(td, &c);
+
+	if (strcmp(cursor_string(&c), "header_page"))
+		goto out_corrupted;
+	text = cursor_text(td, &c, sizeof(uint64_t), &len);
+	if (!text || parse_header_page(td, text, len))
+		goto out_corrupted;
+
+	if (strcmp(cursor_string(&c), "header_event"))
+		goto out_corrupted;
+	cursor_text(td, &c, sizeof(uint64_t), &len);
+
+	/* ftrace internal events */
+	count = cursor_u32(td, &c);
+	for (i = 0; i < count && !c.error; i++)
+		cursor_text(td, &c, sizeof(uint64_t), &len);
+
+	/* event systems */
+	count = cursor_u32(td, &c);
+	for (i = 0; i < count && !c.error; i++) {
+		const char *system = cursor_string(&c);
+
+		nrevents = cursor_u32(td, &c);
+		for (j = 0; j < nrevents && !c.error; j++) {
+			text = cursor_text(td, &c, sizeof(uint64_t), &len);
+			if (text && parse_event_format(td, system, text, len))
+				goto out_free;
+		}
+	}
+
+	/* kallsyms */
+	cursor_text(td, &c, sizeof(uint32_t), &len);
+
+	text = cursor_text(td, &c, sizeof(uint32_t), &len);
+	if (text && parse_printk_formats(td, text, len))
+		goto out_free;
+
+	td->nrcpus = cursor_u32(td, &c);
+	if (c.error || td->nrcpus <= 0)
+		goto out_corrupted;
+
+	p = cursor_string(&c);
+	if (!strcmp(p, "options  ")) {
+		while (!c.error) {
+			p = cursor_take(&c, sizeof(uint16_t));
+			if (!p || !(option = td_u16(td, p)))
+				break;
+			text = cursor_text(td, &c, sizeof(uint32_t), &len);
+			if (option == TRACE_DAT_OPTION_TOPOLOGY) {
+				td->topology = text;
+				td->topology_len = len;
+			}
+		}
+		p = cursor_string(&c);
+	}
+
+	if (strcmp(p, "flyrecord")) {
+		fprintf(stderr, "%s: only trace-cmd files in flyrecord mode "
+			"are supported\n", __func__);
+		goto out_free;
+	}
+
+	if (parse_flyrecord(td, &c))
+		goto out_corrupted;
+
+	if (!td->nrevents)
+		fprintf(stderr, "%s: no event idlestat knows about in "
+			"the trace\n", __func__);
+
+	return td;
+
+out_corrupted:
+	fprintf(stderr, "%s: corrupted trace-cmd file\n", __func__);
+out_free:
+	trace_dat_close(td);
+	return NULL;
+}
+
+int trace_dat_nrcpus(struct trace_dat *td)
+{
+	return td->nrcpus;
+}
+
+/**
+ * trace_dat_topology - get the topology stored by idlestat in the file
+ * @td: the decoder
+ * @len: filled with the length of the topology text
+ *
+ * Return: the topology in the idlestat text format, or NULL if the file
+ * was not recorded by idlestat
+ */
+const char *trace_dat_topology(struct trace_dat *td, size_t *len)
+{
+	*len = td->topology_len;
+
+	return td->topology;
+}
+
+void trace_dat_close(struct trace_dat *td)
+{
+	int i;
+
+	for (i = 0; td->cpus && i < td->nrcpus; i++)
+		free(td->cpus[i].buf);
+	free(td->cpus);
+	free(td->strings);
+	free(td->events);
+	free(td);
+}
+
+static struct trace_dat_event *trace_dat_event_find(struct trace_dat *td,
+						    unsigned int id)
+{
+	int i;
+
+	for (i = 0; i < td->nrevents; i++)
+		if (td->events[i].id == id)
+			return &td->events[i];
+
+	return NULL;
+}
+
+static const struct trace_dat_string *trace_dat_string_find(
+	struct trace_dat *td, uint64_t addr)
+{
+	struct trace_dat_string key = { .addr = addr };
+
+	return bsearch(&key, td->strings, td->nrstrings,
+		       sizeof(*td->strings), string_cmp);
+}
+
+/* copy a name the same way the text parser does, up to a blank */
+static void copy_name(char *name, const char *p, const char *end)
+{
+	size_t i;
+
+	for (i = 0; i < NAMELEN && p < end && *p && *p != ' ' && *p != '\t';
+	     i++)
+		name[i] = *p++;
+	name[i] = '\0';
+}
+
+static int read_field(struct trace_dat *td, const char *record, size_t len,
+		      struct trace_dat_field *field, uint64_t *value)
+{
+	if (field->offset + field->size > len)
+		return -1;
+
+	*value = td_read(td, record + field->offset, field->size);
+
+	return 0;
+}
+
+/* decode a ring buffer record into @ev, recorded on @cpu */
+static int trace_dat_decode(struct trace_dat *td, const char *record,
+			    size_t len, int cpu, struct trace_event *ev)
+{
+	const struct trace_dat_string *string;
+	struct trace_dat_event *event;
+	uint64_t value, arg;
+	size_t offset;
+
+	if (len < sizeof(uint16_t))
+		return -1;
+
+	event = trace_dat_event_find(td, td_u16(td, record));
+	if (!event)
+		return -1;
+
+	if (read_field(td, record, len, &event->fields[0], &value))
+		return -1;
+
+	ev->type = event->desc->type;
+	ev->value = value;
+	ev->cpu = cpu;
+
+	switch (ev->type) {
+	case EVENT_CPU_IDLE:
+	case EVENT_CPU_FREQUENCY:
+		if (read_field(td, record, len, &event->fields[1], &arg) ||
+		    arg > INT_MAX)
+			return -1;
+		ev->cpu = arg;
+		break;
+	case EVENT_IRQ:
+		if (!event->fields[1].data_loc) {
+			offset = event->fields[1].offset;
+		} else {
+			if (read_field(td, record, len, &event->fields[1],
+				       &arg))
+				return -1;
+			offset = arg & 0xffff;
+		}
+		if (offset > len)
+			return -1;
+		copy_name(ev->name, record + offset, record + len);
+		break;
+	case EVENT_IPI:
+		ev->value = -1;
+		string = trace_dat_string_find(td, value);
+		if (string)
+			copy_name(ev->name, string->str,
+				  string->str + string->len);
+		else
+			snprintf(ev->name, sizeof(ev->name), "%llx",
+				 (unsigned long long)value);
+		break;
+	}
+
+	return 0;
+}
+
+/* move to the next page of the CPU buffer */
+static int trace_dat_cpu_page(struct trace_dat_cpu *cpu)
+{
+	struct trace_dat *td = cpu->td;
+	const char *page;
+	uint64_t commit;
+
+	while ((size_t)(cpu->end - cpu->page) >= td->page_size) {
+		page = cpu->page;
+		cpu->page += td->page_size;
+		spill_account(td->page_size);
+
+		if (td->fd >= 0) {
+			if (pread(td->fd, cpu->buf, td->page_size,
+				  page - td->data) != (ssize_t)td->page_size)
+				return -1;
+			page = cpu->buf;
+		}
+
+		commit = td_read(td, page + td->page_commit.offset,
+				 td->page_commit.size) & RB_COMMIT_MASK;
+		if (commit > td->page_size - td->page_data.offset)
+			continue;
+
+		cpu->time = td_u64(td, page + td->page_ts.offset);
+		cpu->p = page + td->page_data.offset;
+		cpu->pend = cpu->p + commit;
+
+		return 0;
+	}
+
+	return -1;
+}
+
+/* decode the next known event of a CPU */
+static int trace_dat_cpu_decode(struct trace_dat_cpu *cpu,
+				struct trace_event *ev)
+{
+	struct trace_dat *td = cpu->td;
+	uint32_t header, type_len, delta, length;
+	const char *record;
+
+	while (1) {
+		if (cpu->pend - cpu->p < 4) {
+			if (trace_dat_cpu_page(cpu))
+				return -1;
+			continue;
+		}
+
+		header = td_u32(td, cpu->p);
+		cpu->p += 4;
+
+		if (td->big_endian) {
+			type_len = header >> RB_TS_SHIFT;
+			delta = header & RB_TS_MASK;
+		} else {
+			type_len = header & RB_TYPE_LEN_MASK;
+			delta = header >> 5;
+		}
+
+		/* the types other than the data carry a 32 bits array */
+		if ((type_len == 0 || type_len >= RB_TYPE_PADDING) &&
+		    cpu->pend - cpu->p < 4) {
+			cpu->p = cpu->pend;
+			continue;
+		}
+
+		switch (type_len) {
+		case RB_TYPE_PADDING:
+			/* a null delta pads the rest of the page, otherwise
+			 * this is a discarded event, the length includes the
+			 * array */
+			length = td_u32(td, cpu->p);
+			if (!delta || length > cpu->pend - cpu->p)
+				cpu->p = cpu->pend;
+			else
+				cpu->p += length;
+			continue;
+		case RB_TYPE_TIME_EXTEND:
+			cpu->time += ((uint64_t)td_u32(td, cpu->p) <<
+				      RB_TS_SHIFT) + delta;
+			cpu->p += 4;
+			continue;
+		case RB_TYPE_TIME_STAMP:
+			cpu->time = ((uint64_t)td_u32(td, cpu->p) <<
+				     RB_TS_SHIFT) + delta;
+			cpu->p += 4;
+			continue;
+		case 0:
+			/* the length includes the array itself */
+			length = td_u32(td, cpu->p);
+			record = cpu->p + 4;
+			if (length < 4 || length > cpu->pend - cpu->p) {
+				cpu->p = cpu->pend;
+				continue;
+			}
+			cpu->p += length;
+			length -= 4;
+			break;
+		default:
+			record = cpu->p;
+			length = type_len * 4;
+			if (length > cpu->pend - cpu->p) {
+				cpu->p = cpu->pend;
+				continue;
+			}
+			cpu->p += length;
+			break;
+		}
+
+		cpu->time += delta;
+
+		if (!trace_dat_decode(td, record, length, cpu->src.id, ev)) {
+			ev->time = cpu->time;
+			return 0;
+		}
+	}
+}
+
+/* the event_source of a CPU */
+static struct trace_event *trace_dat_cpu_next(struct event_source *src)
+{
+	struct trace_dat_cpu *cpu = container_of(src, struct trace_dat_cpu,
+						 src);
+
+	if (cpu->next == cpu->nrevents) {
+		cpu->next = cpu->nrevents = 0;
+		while (cpu->nrevents < TRACE_DAT_BATCH &&
+		       !trace_dat_cpu_decode(cpu,
+					     &cpu->events[cpu->nrevents]))
+			cpu->nrevents++;
+		if (!cpu->nrevents)
+			return NULL;
+	}
+
+	return &cpu->events[cpu->next++];
+}
+
+/**
+ * trace_dat_import - load the events of a trace-cmd binary file
+ * @td: the decoder returned by trace_dat_open()
+ * @datas: the per-CPU statistics to fill
+ * @stats: filled with the log duration and the number of events
+ * @window: the time window to import, NULL for the whole trace
+ *
+ * The pages of each CPU are decoded as a time ordered stream and the
+ * streams are merged, so the events are stored in the trace order.
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int trace_dat_import(struct trace_dat *td, struct cpuidle_datas *datas,
+		     struct import_stats *stats, struct import_window *window)
+{
+	struct event_source **sources;
+	struct event_merge merge;
+	struct trace_event *ev;
+	int i, ret = 0;
+
+	sources = malloc(sizeof(*sources) * td->nrcpus);
+	if (!sources)
+		return -1;
+
+	for (i = 0; i < td->nrcpus; i++) {
+		td->cpus[i].src.next = trace_dat_cpu_next;
+		td->cpus[i].src.id = i;
+		sources[i] = &td->cpus[i].src;
+	}
+
+	if (event_merge_init(&merge, sources, td->nrcpus)) {
+		free(sources);
+		return -1;
+	}
+
+	while ((ev = event_merge_next(&merge))) {
+		if (ev->cpu >= datas->nrcpus)
+			continue;
+
+		if (window) {
+			ret = import_window_store(window, datas, ev, stats);
+			if (ret)
+				break;
+			continue;
+		}
+
+		import_stats_account(stats, ev);
+		ret = store_event(datas, ev, stats->count - 1);
+		if (ret)
+			break;
+	}
+
+	event_merge_release(&merge);
+	free(sources);
+
+	return ret < 0 ? -1 : 0;
+}
+
+/*
+ * The recording side. The pages of the kernel ring buffers are read in
+ * binary from the per-CPU trace_pipe_raw files and stored as they are,
+ * with the format descriptions of the events, in a trace-cmd version 6
+ * file. Nothing is formatted by the kernel nor parsed by idlestat, and
+ * the file can also be read by the trace-cmd tools.
+ */
+
+static void write_u16(FILE *f, uint16_t value)
+{
+	fwrite(&value, sizeof(value), 1, f);
+}
+
+static void write_u32(FILE *f, uint32_t value)
+{
+	fwrite(&value, sizeof(value), 1, f);
+}
+
+static void write_u64(FILE *f, uint64_t value)
+{
+	fwrite(&value, sizeof(value), 1, f);
+}
+
+/* write a block of text preceded by its size on @size_len bytes */
+static void write_text(FILE *f, const char *text, size_t len, size_t size_len)
+{
+	if (size_len == sizeof(uint64_t))
+		write_u64(f, len);
+	else
+		write_u32(f, len);
+
+	fwrite(text, 1, len, f);
+}
+
+/* read a whole tracefs file, their size is not known in advance */
+static char *read_file(const char *path, size_t *len)
+{
+	char *buf = NULL, *tmp;
+	size_t size = 0, ret;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return NULL;
+
+	*len = 0;
+	do {
+		if (*len == size) {
+			size = size ? size * 2 : 4096;
+			tmp = realloc(buf, size);
+			if (!tmp) {
+				free(buf);
+				fclose(f);
+				return NULL;
+			}
+			buf = tmp;
+		}
+
+		ret = fread(buf + *len, 1, size - *len, f);
+		*len += ret;
+	} while (ret);
+
+	fclose(f);
+
+	return buf;
+}
+
+static int write_file(FILE *f, const char *path, size_t size_len)
+{
+	char *text;
+	size_t len;
+
+	text = read_file(path, &len);
+	if (!text) {
+		fprintf(stderr, "%s: failed to read '%s': %m\n", __func__, path);
+		return -1;
+	}
+
+	write_text(f, text, len, size_len);
+	free(text);
+
+	return 0;
+}
+
+/* the format of the events idlestat knows about, grouped by system */
+static int write_event_formats(FILE *f)
+{
+	const struct event_desc *desc, *first;
+	int i, nrevents = 0, nrsystems = 0, count, ret = -1;
+	size_t *lens;
+	char **formats, *path;
+
+	for_each_event_desc(desc)
+		nrevents++;
+
+	formats = calloc(nrevents, sizeof(*formats));
+	lens = calloc(nrevents, sizeof(*lens));
+	if (!formats || !lens)
+		goto out;
+
+	for_each_event_desc(desc) {
+		i = desc - event_descs;
+
+		if (asprintf(&path, TRACE_EVENT_FORMAT_PATH_FORMAT,
+			     desc->system, desc->name) < 0)
+			goto out;
+
+		formats[i] = read_file(path, &lens[i]);
+		free(path);
+
+		if (!formats[i] && !desc->optional) {
+			fprintf(stderr, "%s: no format for event %s:%s\n",
+				__func__, desc->system, desc->name);
+			goto out;
+		}
+
+		if (desc == event_descs || strcmp(desc[-1].system, desc->system))
+			nrsystems++;
+	}
+
+	write_u32(f, nrsystems);
+
+	/* the events of a system follow each other in the table */
+	for (first = event_descs; first->name; first = desc) {
+		for (desc = first, count = 0;
+		     desc->name && !strcmp(desc->system, first->system); desc++)
+			count += formats[desc - event_descs] != NULL;
+
+		fwrite(first->system, 1, strlen(first->system) + 1, f);
+		write_u32(f, count);
+
+		for (desc = first;
+		     desc->name && !strcmp(desc->system, first->system); desc++) {
+			i = desc - event_descs;
+			if (!formats[i])
+				continue;
+			write_text(f, formats[i], lens[i], sizeof(uint64_t));
+		}
+	}
+
+	ret = 0;
+out:
+	for (i = 0; formats && i < nrevents; i++)
+		free(formats[i]);
+	free(formats);
+	free(lens);
+
+	return ret;
+}
+
+static void write_topology(FILE *f)
+{
+	char *text = NULL;
+	size_t len = 0;
+	FILE *m;
+
+	m = open_memstream(&text, &len);
+	if (!m)
+		return;
+
+	output_cpu_topo_info(m);
+	fclose(m);
+
+	if (len) {
+		write_u16(f, TRACE_DAT_OPTION_TOPOLOGY);
+		write_text(f, text, len, sizeof(uint32_t));
+	}
+
+	free(text);
+}
+
+/* copy the pages of a CPU buffer, return the number of bytes copied */
+static int64_t write_cpu_pages(FILE *f, int cpu, char *page, long page_size)
+{
+	int64_t size = 0;
+	ssize_t ret;
+	char *path;
+	int fd;
+
+	if (asprintf(&path, TRACE_CPU_RAW_PATH_FORMAT, cpu) < 0)
+		return -1;
+
+	/* the tracing is stopped, read until the buffer is empty */
+	fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		fprintf(stderr, "%s: failed to open '%s': %m\n", __func__, path);
+		free(path);
+		return -1;
+	}
+	free(path);
+
+	while (1) {
+		ret = read(fd, page, page_size);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+
+		/* keep the pages aligned in the file */
+		memset(page + ret, 0, page_size - ret);
+		fwrite(page, 1, page_size, f);
+		size += page_size;
+	}
+
+	close(fd);
+
+	if (ret < 0 && errno != EAGAIN) {
+		fprintf(stderr, "%s: failed to read cpu%d buffer: %m\n",
+			__func__, cpu);
+		return -1;
+	}
+
+	return size;
+}
+
+/* the file is patched while written, it is compressed once complete */
+static int write_compressed(FILE *f, const char *path,
+			    const struct compressor *c, char *buf, size_t size)
+{
+	FILE *out;
+	size_t len;
+	pid_t pid;
+	int fd, ret = 0;
+
+	out = fopen(path, "w");
+	if (!out) {
+		fprintf(stderr, "%s: failed to open '%s': %m\n", __func__, path);
+		return -1;
+	}
+
+	fd = compressor_spawn(c, 0, fileno(out), &pid);
+	if (fd < 0) {
+		fclose(out);
+		return -1;
+	}
+
+	rewind(f);
+	while ((len = fread(buf, 1, size, f)))
+		if (write(fd, buf, len) != len) {
+			ret = -1;
+			break;
+		}
+
+	close(fd);
+	if (compressor_wait(c, pid))
+		ret = -1;
+	fclose(out);
+
+	return ret;
+}
+
+/**
+ * trace_dat_record - store the content of the kernel ring buffers
+ * @path: the trace file to write, compressed when its name asks for it
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int trace_dat_record(const char *path)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	int nrcpus = sysconf(_SC_NPROCESSORS_CONF);
+	const struct compressor *c = compressor_for_path(path);
+	uint64_t *table;
+	int64_t size;
+	off_t offset;
+	char *page;
+	FILE *f;
+	int cpu, ret = -1;
+
+	if (page_size < 0 || nrcpus < 0)
+		return -1;
+
+	table = calloc(nrcpus, 2 * sizeof(*table));
+	page = malloc(page_size);
+	if (!table || !page)
+		goto out_free;
+
+	f = c ? tmpfile() : fopen(path, "w+");
+	if (!f) {
+		fprintf(stderr, "%s: failed to open '%s': %m\n", __func__, path);
+		goto out_free;
+	}
+
+	fwrite(TRACE_DAT_MAGIC, 1, TRACE_DAT_MAGIC_LEN, f);
+	fwrite(TRACE_DAT_VERSION, 1, sizeof(TRACE_DAT_VERSION), f);
+	fputc(__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__, f);
+	fputc(sizeof(long), f);
+	write_u32(f, page_size);
+
+	fwrite("header_page", 1, sizeof("header_page"), f);
+	if (write_file(f, TRACE_HEADER_PAGE_PATH, sizeof(uint64_t)))
+		goto out_close;
+
+	fwrite("header_event", 1, sizeof("header_event"), f);
+	if (write_file(f, TRACE_HEADER_EVENT_PATH, sizeof(uint64_t)))
+		goto out_close;
+
+	/* no ftrace internal event */
+	write_u32(f, 0);
+
+	if (write_event_formats(f))
+		goto out_close;
+
+	/* no kallsyms, the printk strings hold the ipi reasons */
+	write_u32(f, 0);
+	if (write_file(f, TRACE_PRINTK_FORMATS_PATH, sizeof(uint32_t)))
+		write_u32(f, 0);
+
+	write_u32(f, nrcpus);
+
+	fwrite("options  ", 1, sizeof("options  "), f);
+	write_topology(f);
+	write_u16(f, 0);
+
+	/* the CPU buffers table is filled once the pages are copied */
+	fwrite("flyrecord", 1, sizeof("flyrecord"), f);
+	offset = ftello(f);
+	fwrite(table, 2 * sizeof(*table), nrcpus, f);
+
+	for (cpu = 0; cpu < nrcpus; cpu++) {
+		while (ftello(f) % page_size)
+			fputc(0, f);
+
+		table[2 * cpu] = ftello(f);
+		size = write_cpu_pages(f, cpu, page, page_size);
+		if (size < 0)
+			goto out_close;
+		table[2 * cpu + 1] = size;
+	}
+
+	fseeko(f, offset, SEEK_SET);
+	fwrite(table, 2 * sizeof(*table), nrcpus, f);
+
+	if (ferror(f))
+		fprintf(stderr, "%s: failed to write '%s'\n", __func__, path);
+	else if (c)
+		ret = write_compressed(f, path, c, page, page_size);
+	else
+		ret = 0;
+
+out_close:
+	fclose(f);
+out_free:
+	free(page);
+	free(table);
+
+	return ret;
+}
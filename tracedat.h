@@ -0,0 +1,44 @@
+/*
+ *  tracedat.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __TRACEDAT_H
+#define __TRACEDAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "idlestat.h"
+#include "import.h"
+#include "tracefile.h"
+
+struct trace_dat;
+
+extern bool trace_dat_match(const char *data, size_t len);
+extern struct trace_dat *trace_dat_open(struct trace_file *tf);
+extern int trace_dat_nrcpus(struct trace_dat *td);
+extern const char *trace_dat_topology(struct trace_dat *td, size_t *len);
+extern int trace_dat_import(struct trace_dat *td, struct cpuidle_datas *datas,
+			    struct import_stats *stats,
+			    struct import_window *window);
+extern void trace_dat_close(struct trace_dat *td);
+extern int trace_dat_record(const char *path);
+
+#endif
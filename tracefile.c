@@ -0,0 +1,395 @@
+/*
+ *  tracefile.c
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tracefile.h"
+#include "compress.h"
+#include "scan.h"
+#include "spill.h"
+
+static int trace_file_map(struct trace_file *tf)
+{
+	struct stat s = tf->stat;
+	void *map;
+
+	if (!S_ISREG(s.st_mode) || !s.st_size)
+		return -1;
+
+	map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, tf->fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+
+	/* The file is walked once from the beginning to the end, let the
+	 * kernel read ahead aggressively and drop the pages behind us. The
+	 * hints are best effort, ignore failures */
+	madvise(map, s.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+	madvise(map, s.st_size, MADV_HUGEPAGE);
+#endif
+	tf->map = map;
+	tf->size = s.st_size;
+	tf->mapsize = s.st_size;
+	spill_watch(map, s.st_size);
+
+	return 0;
+}
+
+/**
+ * trace_file_open - open a trace for import
+ * @path: path of the trace file
+ *
+ * Return: an opened trace file (success) or NULL (error)
+ */
+struct trace_file *trace_file_open(const char *path)
+{
+	struct trace_file *tf;
+	char magic[8];
+	ssize_t ret;
+	int fd;
+
+	tf = calloc(1, sizeof(*tf));
+	if (!tf)
+		return NULL;
+
+	tf->fd = open(path, O_RDONLY);
+	if (tf->fd < 0) {
+		fprintf(stderr, "%s: failed to open '%s': %m\n", __func__, path);
+		free(tf);
+		return NULL;
+	}
+
+	/* the trace is imported as it is now, even if it is appended to
+	 * while being read */
+	if (fstat(tf->fd, &tf->stat))
+		memset(&tf->stat, 0, sizeof(tf->stat));
+
+	/* Compressed files are streamed out of the decompressor. Pipes can
+	 * not be peeked at, they are expected to be decompressed already */
+	ret = pread(tf->fd, magic, sizeof(magic), 0);
+	tf->compressor = ret > 0 ? compressor_match(magic, ret) : NULL;
+	if (tf->compressor) {
+		fd = compressor_spawn(tf->compressor, 1, tf->fd, &tf->pid);
+		close(tf->fd);
+		tf->fd = fd;
+		if (fd < 0) {
+			free(tf);
+			return NULL;
+		}
+	} else if (!trace_file_map(tf))
+		return tf;
+
+	/* Not a regular file, fall back to streaming */
+	tf->bufsize = TRACEFILE_BLOCK_SIZE;
+	tf->buf = malloc(tf->bufsize);
+	if (!tf->buf) {
+		close(tf->fd);
+		free(tf);
+		return NULL;
+	}
+
+	return tf;
+}
+
+/**
+ * trace_file_open_mem - read the lines of a memory buffer
+ * @data: the buffer, it must stay valid until the trace file is closed
+ * @size: the size of the buffer
+ *
+ * Return: an opened trace file (success) or NULL (error)
+ */
+struct trace_file *trace_file_open_mem(const char *data, size_t size)
+{
+	struct trace_file *tf;
+
+	tf = calloc(1, sizeof(*tf));
+	if (!tf)
+		return NULL;
+
+	/* the buffer is handed out like a mapping but is not ours */
+	tf->fd = -1;
+	tf->map = (char *)data;
+	tf->size = size;
+
+	return tf;
+}
+
+/**
+ * trace_file_close - close a trace and wait for its decompressor
+ * @tf: the trace file
+ *
+ * Return: 0 on success, -1 if the decompressor failed, the trace was
+ * then read partially
+ */
+int trace_file_close(struct trace_file *tf)
+{
+	int ret = 0;
+
+	if (!tf)
+		return 0;
+
+	/* a loaded stream is handed out from the buffer, not mapped */
+	if (tf->fd >= 0) {
+		if (tf->map && tf->map != tf->buf) {
+			spill_unwatch(tf->map);
+			munmap(tf->map, tf->mapsize);
+		}
+		close(tf->fd);
+	}
+	if (tf->compressor)
+		ret = compressor_wait(tf->compressor, tf->pid);
+	free(tf->buf);
+	free(tf);
+
+	return ret;
+}
+
+/*
+ * Make room at the end of the streaming buffer and read the next block.
+ * Returns the number of bytes read, 0 at the end of file, -1 on error.
+ */
+static ssize_t trace_file_fill(struct trace_file *tf)
+{
+	ssize_t ret;
+
+	if (tf->start) {
+		memmove(tf->buf, tf->buf + tf->start, tf->end - tf->start);
+		tf->end -= tf->start;
+		tf->start = 0;
+	}
+
+	/* The current line does not fit in the buffer */
+	if (tf->end == tf->bufsize) {
+		char *tmp = realloc(tf->buf, tf->bufsize * 2);
+		if (!tmp)
+			return -1;
+		tf->buf = tmp;
+		tf->bufsize *= 2;
+	}
+
+	do {
+		ret = read(tf->fd, tf->buf + tf->end, tf->bufsize - tf->end);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret > 0)
+		tf->end += ret;
+
+	return ret;
+}
+
+/**
+ * trace_file_getline - return the next line of the trace
+ * @tf: the trace file
+ * @len: filled with the length of the line, without the newline
+ *
+ * The line is not NUL-terminated. It points into the mapping, or into
+ * the streaming buffer in which case it is only valid until the next
+ * call.
+ *
+ * Return: a pointer to the first character of the line or NULL at the
+ * end of the file
+ */
+char *trace_file_getline(struct trace_file *tf, size_t *len)
+{
+	char *line, *eol;
+
+	if (tf->map) {
+		if (tf->pos >= tf->size)
+			return NULL;
+
+		line = tf->map + tf->pos;
+		eol = (char *)scan_char(line, tf->map + tf->size, '\n');
+		*len = eol ? eol - line : tf->size - tf->pos;
+		/* the pages behind are dropped with --memory-limit */
+		if ((tf->pos ^ (tf->pos + *len + 1)) >> SPILL_STEP_SHIFT)
+			spill_account(1UL << SPILL_STEP_SHIFT);
+		tf->pos += *len + 1;
+
+		return line;
+	}
+
+	while (1) {
+		line = tf->buf + tf->start;
+		eol = (char *)scan_char(line, tf->buf + tf->end, '\n');
+		if (eol)
+			break;
+
+		if (!tf->eof && trace_file_fill(tf) > 0)
+			continue;
+
+		/* last line without trailing newline */
+		tf->eof = 1;
+		if (tf->start == tf->end)
+			return NULL;
+
+		line = tf->buf + tf->start;
+		*len = tf->end - tf->start;
+		tf->start = tf->end;
+
+		return line;
+	}
+
+	*len = eol - line;
+	tf->start += *len + 1;
+
+	return line;
+}
+
+/**
+ * trace_file_rewind - go back to a line returned by the last
+ * trace_file_getline() call, so it is read again
+ * @tf: the trace file
+ * @line: the line
+ */
+void trace_file_rewind(struct trace_file *tf, const char *line)
+{
+	if (!line)
+		return;
+
+	if (tf->map)
+		tf->pos = line - tf->map;
+	else
+		tf->start = line - tf->buf;
+}
+
+/**
+ * trace_file_seek - move to an offset of a mapped trace
+ * @tf: the trace file
+ * @offset: the offset of the next line to read
+ *
+ * Return: 0 on success, -1 if the trace is not mapped
+ */
+int trace_file_seek(struct trace_file *tf, size_t offset)
+{
+	if (!tf->map)
+		return -1;
+
+	tf->pos = offset < tf->size ? offset : tf->size;
+
+	return 0;
+}
+
+/**
+ * trace_file_complete - ignore the last line of a mapped trace if it
+ * does not end with a newline yet
+ * @tf: the trace file
+ */
+void trace_file_complete(struct trace_file *tf)
+{
+	const char *eol;
+
+	if (!tf->map || !tf->size || tf->map[tf->size - 1] == '\n')
+		return;
+
+	eol = memrchr(tf->map, '\n', tf->size);
+	tf->size = eol ? eol + 1 - tf->map : 0;
+}
+
+/**
+ * trace_file_read - read the raw content of the trace from the current
+ * position
+ * @tf: the trace file
+ * @buf: the destination buffer
+ * @size: the size of the buffer
+ *
+ * Return: the number of bytes read, 0 at the end of the file, -1 on
+ * error
+ */
+ssize_t trace_file_read(struct trace_file *tf, char *buf, size_t size)
+{
+	ssize_t ret;
+
+	if (tf->map) {
+		ret = tf->pos < tf->size ? tf->size - tf->pos : 0;
+		if (ret > size)
+			ret = size;
+		memcpy(buf, tf->map + tf->pos, ret);
+		tf->pos += ret;
+		return ret;
+	}
+
+	/* flush what is left in the streaming buffer first */
+	if (tf->start < tf->end) {
+		ret = tf->end - tf->start;
+		if (ret > size)
+			ret = size;
+		memcpy(buf, tf->buf + tf->start, ret);
+		tf->start += ret;
+		return ret;
+	}
+
+	do {
+		ret = read(tf->fd, buf, size);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret;
+}
+
+/**
+ * trace_file_load - read the whole stream in memory, from its beginning,
+ * so it can be walked like a mapping
+ * @tf: the trace file, only trace_file_getline() may have been called
+ *
+ * The decompressor is waited for once the stream is read.
+ *
+ * Return: 0 on success, -1 otherwise
+ */
+int trace_file_load(struct trace_file *tf)
+{
+	ssize_t ret;
+
+	if (tf->map)
+		return 0;
+
+	/* the buffer was never shifted, it still starts with the file */
+	tf->start = 0;
+
+	/* with nothing consumed, the buffer grows instead of shifting */
+	while (!tf->eof) {
+		ret = trace_file_fill(tf);
+		if (ret < 0)
+			return -1;
+		if (!ret)
+			tf->eof = 1;
+	}
+
+	tf->map = tf->buf;
+	tf->size = tf->end;
+	tf->pos = 0;
+
+	/* a truncated stream must not be decoded as a whole trace */
+	if (tf->compressor) {
+		ret = compressor_wait(tf->compressor, tf->pid);
+		tf->compressor = NULL;
+		if (ret)
+			return -1;
+	}
+
+	return 0;
+}
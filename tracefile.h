@@ -0,0 +1,65 @@
+/*
+ *  tracefile.h
+ *
+ *  Copyright (C) 2014, Linaro Limited.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+#ifndef __TRACEFILE_H
+#define __TRACEFILE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* Size of the blocks read from a trace which can not be mapped */
+#define TRACEFILE_BLOCK_SIZE (1 << 20)
+
+/*
+ * A trace file opened for import. Regular files are mapped and the
+ * lines are handed out in place. Pipes, compressed files and other
+ * unmappable files are read by blocks into a buffer, which grows when a
+ * line does not fit.
+ */
+struct trace_file {
+	int fd;
+	const struct compressor *compressor;
+	pid_t pid;		/* the decompressor */
+	char *map;		/* mapped file, NULL when streaming */
+	size_t size;		/* size of the mapped trace */
+	size_t mapsize;		/* size of the mapping */
+	char *buf;		/* streaming buffer */
+	size_t bufsize;
+	size_t start;		/* first unconsumed byte in buf */
+	size_t end;		/* end of valid data in buf */
+	size_t pos;		/* current offset in the mapping */
+	int eof;
+	struct stat stat;	/* of the file when it was opened, zeroed
+				 * for the memory buffers */
+};
+
+extern struct trace_file *trace_file_open(const char *path);
+extern struct trace_file *trace_file_open_mem(const char *data, size_t size);
+extern int trace_file_close(struct trace_file *tf);
+extern char *trace_file_getline(struct trace_file *tf, size_t *len);
+extern void trace_file_rewind(struct trace_file *tf, const char *line);
+extern int trace_file_seek(struct trace_file *tf, size_t offset);
+extern void trace_file_complete(struct trace_file *tf);
+extern ssize_t trace_file_read(struct trace_file *tf, char *buf, size_t size);
+extern int trace_file_load(struct trace_file *tf);
+
+#endif
@@ -28,8 +28,11 @@
 #include <stdio.h>
 #undef _GNU_SOURCE
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 
 #include "utils.h"
+#include "idlestat.h"
 
 int write_int(const char *path, int val)
 {
@@ -66,15 +69,16 @@ int read_int(const char *path, int *val)
 	return 0;
 }
 
-int store_line(const char *line, void *data)
+int store_line(const char *line, size_t len, void *data)
 {
 	FILE *f = data;
 
 	/* ignore comment line */
-	if (line[0] == '#')
+	if (len && line[0] == '#')
 		return 0;
 
-	fprintf(f, "%s", line);
+	if (fwrite(line, 1, len, f) != len || fputc('\n', f) == EOF)
+		return -1;
 
 	return 0;
 }
@@ -114,3 +118,53 @@ out_free:
 	free(rpath);
 	return ret;
 }
+
+/*
+ * Allocate a zeroed array whose elements may be cache line aligned
+ * structures, calloc() only guarantees the alignment of the basic types.
+ */
+void *aligned_calloc(size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	if (posix_memalign(&ptr, CACHELINE_SIZE, nmemb * size))
+		return NULL;
+
+	memset(ptr, 0, nmemb * size);
+
+	return ptr;
+}
+
+/*
+ * Parse a "<prefix><number>" line of a trace header, without requiring
+ * the line to be NUL-terminated. Leading blanks are skipped.
+ *
+ * @line : the line to be parsed
+ * @len : length of the line
+ * @prefix : the string expected before the number
+ * @value : a pointer to an integer to store the number
+ * Returns 0 on success, -1 otherwise
+ */
+int line_scan_int(const char *line, size_t len, const char *prefix, int *value)
+{
+	const char *end = line + len;
+	size_t plen = strlen(prefix);
+	int val = 0;
+
+	while (line < end && isspace(*line))
+		line++;
+
+	if ((size_t)(end - line) <= plen || memcmp(line, prefix, plen))
+		return -1;
+
+	line += plen;
+	if (!isdigit(*line))
+		return -1;
+
+	while (line < end && isdigit(*line))
+		val = val * 10 + *line++ - '0';
+
+	*value = val;
+
+	return 0;
+}
@@ -27,10 +27,15 @@
 #ifndef __UTILS_H
 #define __UTILS_H
 
+#include <stddef.h>
+
 extern int write_int(const char *path, int val);
 extern int read_int(const char *path, int *val);
-extern int store_line(const char *line, void *data);
+extern int store_line(const char *line, size_t len, void *data);
 extern int file_read_value(const char *path, const char *name,
 				const char *format, void *value);
+extern void *aligned_calloc(size_t nmemb, size_t size);
+extern int line_scan_int(const char *line, size_t len, const char *prefix,
+				int *value);
 
 #endif